@@ -1,6 +1,12 @@
 // NOTE: Per assignment rules, only this single include is allowed here.
 #include "VectorStore.h"
 
+// Threading is opt-in (-DVECTORSTORE_THREADS); the default build stays single-include
+#ifdef VECTORSTORE_THREADS
+#include <thread>
+#include <atomic>
+#endif
+
 // =====================================
 // Helper functions
 // =====================================
@@ -12,6 +18,636 @@ void printNSpace(int n) {
     }
 }
 
+// Runs body(i) for every i in [begin, end) on up to `threads` threads (the
+// caller's thread included), handing out indices one at a time so uneven
+// work still balances. body must not throw. Without VECTORSTORE_THREADS,
+// or with threads <= 1, this is a plain loop.
+template <class Body>
+static void parallelFor(int begin, int end, int threads, const Body& body) {
+#ifdef VECTORSTORE_THREADS
+    if (threads > end - begin) threads = end - begin;
+    if (threads > 1) {
+        std::atomic<int> next(begin);
+        auto worker = [&]() {
+            for (int i = next++; i < end; i = next++) body(i);
+        };
+        vector<std::thread> pool;
+        pool.reserve(threads - 1);
+        for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (std::thread& th : pool) th.join();
+        return;
+    }
+#else
+    (void)threads;
+#endif
+    for (int i = begin; i < end; ++i) body(i);
+}
+
+// Number of pieces to split `items` units of scan work into: one per thread,
+// but never so many that a thread gets less than MIN_ITEMS_PER_THREAD units
+static int partitionCount(int items, int threads) {
+    const int MIN_ITEMS_PER_THREAD = 4096;
+    int parts = items / MIN_ITEMS_PER_THREAD;
+    if (parts > threads) parts = threads;
+    return parts < 1 ? 1 : parts;
+}
+
+// Distance kernels over raw rows of n floats (arena rows or vector data).
+// Without GCC/Clang each metric is a portable scalar loop accumulating in
+// double. With them there are SIMD versions written with vector extensions:
+// 4 lanes (SSE2 on x86-64, NEON on ARM), and on x86 8 lanes (AVX2/FMA) and
+// 16 lanes (AVX-512F). Lanes accumulate in float; lane sums and the tail are
+// combined in double. The widest version the CPU supports is picked once,
+// on first use, and every caller goes through l1Kernel/l2Kernel/cosineKernel.
+// -DVECTORSTORE_SCALAR_KERNELS forces the scalar versions.
+//
+// The code kernels score float query operands against a row of 8-bit codes
+// (see ScalarQuantizer): each code c_i stands for offset_i + scale_i * c_i,
+// so with u = query - offset the L1 distance is sum |u_i - scale_i * c_i|,
+// and the dot product (which the L2 distance is expanded into) is
+// sum w_i * c_i plus a per-query constant. The SIMD versions read codes as
+// 32-bit words and split them into byte planes with shifts and masks (GCC
+// scalarizes byte-to-float vector conversions), so the operands are laid
+// out to match: see codeOrder.
+//
+// The packed kernels score a float query against a row stored as 16-bit
+// values (see StoragePrecision), widened to float lanes in registers. The
+// dispatch picks FP16 versions that use the F16C / AVX-512F conversion
+// instruction where the CPU has it.
+//
+// The Hamming kernel counts the differing bits of two SimHash signatures
+// (words of 64 bits). It is a SWAR bit count, except on x86 CPUs with POPCNT.
+#if defined(__GNUC__) && !defined(VECTORSTORE_SCALAR_KERNELS)
+#define VECTORSTORE_SIMD
+#if defined(__x86_64__) || defined(__i386__)
+#define VECTORSTORE_SIMD_X86
+#endif
+#endif
+
+// Where the code kernels expect the operand for dimension i of n: within
+// each full block of 64 dimensions, dimension 4k + b sits at 16b + k (byte
+// plane b of word k), so every plane of codes lines up with contiguous
+// operands. The n % 64 trailing dimensions keep their places.
+static int codeOrder(int i, int n) {
+    if (i >= n / 64 * 64) return i;
+    int r = i % 64;
+    return i - r + 16 * (r % 4) + r / 4;
+}
+
+// 16-bit storage formats. FP16 is IEEE binary16 and BF16 the top half of a
+// float; both round to nearest even. Finite values beyond FP16's range
+// saturate to +-65504 (and BF16's to +-FLT_MAX) instead of becoming inf.
+// Bits are moved with char copies since <cstring> is not among the includes.
+static unsigned int floatBits(float value) {
+    unsigned int bits;
+    const char* from = reinterpret_cast<const char*>(&value);
+    std::copy(from, from + sizeof(bits), reinterpret_cast<char*>(&bits));
+    return bits;
+}
+static float bitsToFloat(unsigned int bits) {
+    float value;
+    const char* from = reinterpret_cast<const char*>(&bits);
+    std::copy(from, from + sizeof(value), reinterpret_cast<char*>(&value));
+    return value;
+}
+static unsigned short floatToHalf(float value) {
+    unsigned int bits = floatBits(value);
+    unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+    unsigned int magnitude = bits & 0x7fffffff;
+    if (magnitude > 0x7f800000) return sign | 0x7e00;   // NaN
+    if (magnitude == 0x7f800000) return sign | 0x7c00;  // inf
+    if (magnitude >= 0x477fe000) return sign | 0x7bff;  // saturate at 65504
+    if (magnitude < 0x38800000) {
+        // Subnormal (or zero): adding 0.5 lines the float's last mantissa
+        // bit up with 2^-24, so the FPU does the rounding
+        unsigned int shifted = floatBits(bitsToFloat(magnitude) + 0.5f);
+        return sign | (unsigned short)(shifted - 0x3f000000);
+    }
+    // Rebias the exponent (127 -> 15), then round half to even at bit 13
+    magnitude += ((unsigned int)(15 - 127) << 23) + 0xfff + ((magnitude >> 13) & 1);
+    return sign | (unsigned short)(magnitude >> 13);
+}
+static float halfToFloat(unsigned short half) {
+    unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+    unsigned int magnitude = (unsigned int)(half & 0x7fff) << 13;
+    if ((half & 0x7c00) == 0x7c00) return bitsToFloat(sign | magnitude | 0x7f800000); // inf / NaN
+    // Multiplying by 2^112 rebiases the exponent and normalizes subnormals
+    return bitsToFloat(sign | floatBits(bitsToFloat(magnitude) * 0x1p112f));
+}
+static unsigned short floatToBFloat16(float value) {
+    unsigned int bits = floatBits(value);
+    if ((bits & 0x7fffffff) > 0x7f800000) return (unsigned short)((bits >> 16) | 0x40); // quiet NaN
+    unsigned int rounded = bits + 0x7fff + ((bits >> 16) & 1);
+    if ((rounded & 0x7f800000) == 0x7f800000 && (bits & 0x7f800000) != 0x7f800000) {
+        rounded = (bits & 0x80000000) | 0x7f7f0000; // saturate at the largest finite value
+    }
+    return (unsigned short)(rounded >> 16);
+}
+static float bfloat16ToFloat(unsigned short value) {
+    return bitsToFloat((unsigned int)value << 16);
+}
+template <StoragePrecision F>
+static float widenScalar(unsigned short value) {
+    return F == FP16 ? halfToFloat(value) : bfloat16ToFloat(value);
+}
+static unsigned short packValue(float value, StoragePrecision precision) {
+    return precision == FP16 ? floatToHalf(value) : floatToBFloat16(value);
+}
+// The float closest to value that the precision can hold
+static float roundToPrecision(float value, StoragePrecision precision) {
+    if (precision == FP32) return value;
+    unsigned short packed = packValue(value, precision);
+    return precision == FP16 ? halfToFloat(packed) : bfloat16ToFloat(packed);
+}
+
+static int hammingScalar(const unsigned long long* a, const unsigned long long* b, int words) {
+    int distance = 0;
+    for (int w = 0; w < words; ++w) {
+        unsigned long long x = a[w] ^ b[w];
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        distance += (int)((x * 0x0101010101010101ULL) >> 56);
+    }
+    return distance;
+}
+
+static double cosineFromSums(double dotProduct, double normA, double normB) {
+    // Handle potential division by zero 
+    if (normA == 0.0 || normB == 0.0) {
+        return 0.0;
+    }
+    return dotProduct / (sqrt(normA) * sqrt(normB));
+}
+
+#ifndef VECTORSTORE_SIMD
+static double l1Scalar(const float* a, const float* b, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) {
+        sum += fabs(a[i] - b[i]);
+    }
+    return sum;
+}
+static double l2Scalar(const float* a, const float* b, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+}
+static double dotScalar(const float* a, const float* b, int n) {
+    double dotProduct = 0.0;
+    for (int i = 0; i < n; ++i) {
+        dotProduct += a[i] * b[i];
+    }
+    return dotProduct;
+}
+static double cosineScalar(const float* a, const float* b, int n) {
+    double dotProduct = 0.0;
+    double normA = 0.0;
+    double normB = 0.0;
+    for (int i = 0; i < n; ++i) {
+        dotProduct += a[i] * b[i];
+        normA += a[i] * a[i];
+        normB += b[i] * b[i];
+    }
+    return cosineFromSums(dotProduct, normA, normB);
+}
+static double codeL1Scalar(const float* u, const float* scale, const unsigned char* codes, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) {
+        int j = codeOrder(i, n);
+        sum += fabs(u[j] - scale[j] * codes[i]);
+    }
+    return sum;
+}
+static double codeDotScalar(const float* w, const unsigned char* codes, int n) {
+    double dotProduct = 0.0;
+    for (int i = 0; i < n; ++i) {
+        dotProduct += w[codeOrder(i, n)] * codes[i];
+    }
+    return dotProduct;
+}
+template <StoragePrecision F>
+static double packedL1Scalar(const float* a, const unsigned short* b, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) {
+        sum += fabs(a[i] - widenScalar<F>(b[i]));
+    }
+    return sum;
+}
+template <StoragePrecision F>
+static double packedL2Scalar(const float* a, const unsigned short* b, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double diff = a[i] - widenScalar<F>(b[i]);
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+}
+template <StoragePrecision F>
+static double packedDotScalar(const float* a, const unsigned short* b, int n) {
+    double dotProduct = 0.0;
+    for (int i = 0; i < n; ++i) {
+        dotProduct += a[i] * widenScalar<F>(b[i]);
+    }
+    return dotProduct;
+}
+#else
+typedef float Float4  __attribute__((vector_size(16)));
+typedef int   Int4    __attribute__((vector_size(16)));
+typedef unsigned short Packed4 __attribute__((vector_size(8)));
+#ifdef VECTORSTORE_SIMD_X86
+typedef float Float8  __attribute__((vector_size(32)));
+typedef int   Int8    __attribute__((vector_size(32)));
+typedef unsigned short Packed8 __attribute__((vector_size(16)));
+typedef float Float16 __attribute__((vector_size(64)));
+typedef int   Int16   __attribute__((vector_size(64)));
+typedef unsigned short Packed16 __attribute__((vector_size(32)));
+#endif
+
+// Kernel bodies, instantiated once per lane width V (with IV the matching
+// int vector). They are always inlined into the per-ISA entry points below so
+// each copy is compiled for that entry point's target; loads go through
+// memcpy so rows need no particular alignment.
+template <class V, class IV>
+static inline __attribute__((always_inline)) double l1Simd(const float* a, const float* b, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    const IV absMask = (IV){} + 0x7fffffff;
+    V acc0 = {}, acc1 = {};
+    int i = 0;
+    for (; i + 2 * W <= n; i += 2 * W) {
+        V x0, y0, x1, y1;
+        __builtin_memcpy(&x0, a + i, sizeof(V));
+        __builtin_memcpy(&y0, b + i, sizeof(V));
+        __builtin_memcpy(&x1, a + i + W, sizeof(V));
+        __builtin_memcpy(&y1, b + i + W, sizeof(V));
+        acc0 += (V)((IV)(x0 - y0) & absMask);
+        acc1 += (V)((IV)(x1 - y1) & absMask);
+    }
+    acc0 += acc1;
+    double sum = 0.0;
+    for (int j = 0; j < W; ++j) sum += acc0[j];
+    for (; i < n; ++i) sum += fabs(a[i] - b[i]);
+    return sum;
+}
+template <class V>
+static inline __attribute__((always_inline)) double l2SquaredSimd(const float* a, const float* b, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    V acc0 = {}, acc1 = {};
+    int i = 0;
+    for (; i + 2 * W <= n; i += 2 * W) {
+        V x0, y0, x1, y1;
+        __builtin_memcpy(&x0, a + i, sizeof(V));
+        __builtin_memcpy(&y0, b + i, sizeof(V));
+        __builtin_memcpy(&x1, a + i + W, sizeof(V));
+        __builtin_memcpy(&y1, b + i + W, sizeof(V));
+        V d0 = x0 - y0, d1 = x1 - y1;
+        acc0 += d0 * d0;
+        acc1 += d1 * d1;
+    }
+    acc0 += acc1;
+    double sum = 0.0;
+    for (int j = 0; j < W; ++j) sum += acc0[j];
+    for (; i < n; ++i) {
+        double diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+template <class V>
+static inline __attribute__((always_inline)) double dotSimd(const float* a, const float* b, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    V acc0 = {}, acc1 = {};
+    int i = 0;
+    for (; i + 2 * W <= n; i += 2 * W) {
+        V x0, y0, x1, y1;
+        __builtin_memcpy(&x0, a + i, sizeof(V));
+        __builtin_memcpy(&y0, b + i, sizeof(V));
+        __builtin_memcpy(&x1, a + i + W, sizeof(V));
+        __builtin_memcpy(&y1, b + i + W, sizeof(V));
+        acc0 += x0 * y0;
+        acc1 += x1 * y1;
+    }
+    acc0 += acc1;
+    double dotProduct = 0.0;
+    for (int j = 0; j < W; ++j) dotProduct += acc0[j];
+    for (; i < n; ++i) dotProduct += a[i] * b[i];
+    return dotProduct;
+}
+template <class V>
+static inline __attribute__((always_inline)) double cosineSimd(const float* a, const float* b, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    V dot = {}, sqA = {}, sqB = {};
+    int i = 0;
+    for (; i + W <= n; i += W) {
+        V x, y;
+        __builtin_memcpy(&x, a + i, sizeof(V));
+        __builtin_memcpy(&y, b + i, sizeof(V));
+        dot += x * y;
+        sqA += x * x;
+        sqB += y * y;
+    }
+    double dotProduct = 0.0, normA = 0.0, normB = 0.0;
+    for (int j = 0; j < W; ++j) {
+        dotProduct += dot[j];
+        normA += sqA[j];
+        normB += sqB[j];
+    }
+    for (; i < n; ++i) {
+        dotProduct += a[i] * b[i];
+        normA += a[i] * a[i];
+        normB += b[i] * b[i];
+    }
+    return cosineFromSums(dotProduct, normA, normB);
+}
+// Code kernels. Each 64-code block is read as 16 words; plane b of word k is
+// the code of dimension 4k + b, scored against operand 16b + k.
+static constexpr int planeShift(int b) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return 8 * (3 - b);
+#else
+    return 8 * b;
+#endif
+}
+template <class V, class IV>
+static inline __attribute__((always_inline)) double codeL1Simd(const float* u, const float* scale, const unsigned char* codes, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    const IV absMask = (IV){} + 0x7fffffff;
+    const int blocked = n / 64 * 64;
+    V acc0 = {}, acc1 = {};
+    for (int i = 0; i < blocked; i += 64) {
+        for (int k = 0; k < 16; k += W) {
+            IV words;
+            __builtin_memcpy(&words, codes + i + 4 * k, sizeof(IV));
+            for (int b = 0; b < 4; ++b) {
+                V x, s;
+                __builtin_memcpy(&x, u + i + 16 * b + k, sizeof(V));
+                __builtin_memcpy(&s, scale + i + 16 * b + k, sizeof(V));
+                V d = x - s * __builtin_convertvector((words >> planeShift(b)) & 0xff, V);
+                if (b % 2 == 0) acc0 += (V)((IV)d & absMask);
+                else acc1 += (V)((IV)d & absMask);
+            }
+        }
+    }
+    acc0 += acc1;
+    double sum = 0.0;
+    for (int j = 0; j < W; ++j) sum += acc0[j];
+    for (int i = blocked; i < n; ++i) sum += fabs(u[i] - scale[i] * codes[i]);
+    return sum;
+}
+template <class V, class IV>
+static inline __attribute__((always_inline)) double codeDotSimd(const float* w, const unsigned char* codes, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    const int blocked = n / 64 * 64;
+    V acc0 = {}, acc1 = {};
+    for (int i = 0; i < blocked; i += 64) {
+        for (int k = 0; k < 16; k += W) {
+            IV words;
+            __builtin_memcpy(&words, codes + i + 4 * k, sizeof(IV));
+            for (int b = 0; b < 4; ++b) {
+                V x;
+                __builtin_memcpy(&x, w + i + 16 * b + k, sizeof(V));
+                V c = __builtin_convertvector((words >> planeShift(b)) & 0xff, V);
+                if (b % 2 == 0) acc0 += x * c;
+                else acc1 += x * c;
+            }
+        }
+    }
+    acc0 += acc1;
+    double dotProduct = 0.0;
+    for (int j = 0; j < W; ++j) dotProduct += acc0[j];
+    for (int i = blocked; i < n; ++i) dotProduct += w[i] * codes[i];
+    return dotProduct;
+}
+
+// Packed kernels: PV is the 16-bit vector with as many lanes as V. BF16 is
+// widened with a shift. FP16 goes through vcvtph2ps when HW is set (only in
+// entry points whose target has it) and otherwise rebiases the exponent with
+// one multiply, patching inf / NaN with a mask.
+#ifdef VECTORSTORE_SIMD_X86
+// Not always_inline: they are inlined once the kernel body has landed in an
+// entry point with a matching target
+__attribute__((target("avx2,fma,f16c"))) static inline void widenHalfHardware(const unsigned short* p, Float8& out) {
+    typedef short Half8 __attribute__((vector_size(16)));
+    Half8 half;
+    __builtin_memcpy(&half, p, sizeof(half));
+    out = __builtin_ia32_vcvtph2ps256(half);
+}
+__attribute__((target("avx512f"))) static inline void widenHalfHardware(const unsigned short* p, Float16& out) {
+    typedef short Half16 __attribute__((vector_size(32)));
+    Half16 half;
+    __builtin_memcpy(&half, p, sizeof(half));
+    out = __builtin_ia32_vcvtph2ps512_mask(half, (Float16){}, (short)-1, 4 /* current rounding */);
+}
+#endif
+template <class V, class IV, class PV, StoragePrecision F, bool HW>
+static inline __attribute__((always_inline)) void widenPacked(const unsigned short* p, V& out) {
+    if constexpr (HW) {
+        widenHalfHardware(p, out); // x86 entry points only
+    } else {
+        PV packed;
+        __builtin_memcpy(&packed, p, sizeof(PV));
+        IV bits = __builtin_convertvector(packed, IV);
+        if constexpr (F == BF16) {
+            out = (V)(bits << 16);
+        } else {
+            V magnitude = (V)((bits & 0x7fff) << 13) * 0x1p112f;
+            IV special = (bits & 0x7c00) == 0x7c00;
+            out = (V)((IV)magnitude | (special & 0x7f800000) | ((bits & 0x8000) << 16));
+        }
+    }
+}
+template <class V, class IV, class PV, StoragePrecision F, bool HW>
+static inline __attribute__((always_inline)) double packedL1Simd(const float* a, const unsigned short* b, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    const IV absMask = (IV){} + 0x7fffffff;
+    V acc0 = {}, acc1 = {};
+    int i = 0;
+    for (; i + 2 * W <= n; i += 2 * W) {
+        V x0, y0, x1, y1;
+        __builtin_memcpy(&x0, a + i, sizeof(V));
+        widenPacked<V, IV, PV, F, HW>(b + i, y0);
+        __builtin_memcpy(&x1, a + i + W, sizeof(V));
+        widenPacked<V, IV, PV, F, HW>(b + i + W, y1);
+        acc0 += (V)((IV)(x0 - y0) & absMask);
+        acc1 += (V)((IV)(x1 - y1) & absMask);
+    }
+    acc0 += acc1;
+    double sum = 0.0;
+    for (int j = 0; j < W; ++j) sum += acc0[j];
+    for (; i < n; ++i) sum += fabs(a[i] - widenScalar<F>(b[i]));
+    return sum;
+}
+template <class V, class IV, class PV, StoragePrecision F, bool HW>
+static inline __attribute__((always_inline)) double packedL2SquaredSimd(const float* a, const unsigned short* b, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    V acc0 = {}, acc1 = {};
+    int i = 0;
+    for (; i + 2 * W <= n; i += 2 * W) {
+        V x0, y0, x1, y1;
+        __builtin_memcpy(&x0, a + i, sizeof(V));
+        widenPacked<V, IV, PV, F, HW>(b + i, y0);
+        __builtin_memcpy(&x1, a + i + W, sizeof(V));
+        widenPacked<V, IV, PV, F, HW>(b + i + W, y1);
+        V d0 = x0 - y0, d1 = x1 - y1;
+        acc0 += d0 * d0;
+        acc1 += d1 * d1;
+    }
+    acc0 += acc1;
+    double sum = 0.0;
+    for (int j = 0; j < W; ++j) sum += acc0[j];
+    for (; i < n; ++i) {
+        double diff = a[i] - widenScalar<F>(b[i]);
+        sum += diff * diff;
+    }
+    return sum;
+}
+template <class V, class IV, class PV, StoragePrecision F, bool HW>
+static inline __attribute__((always_inline)) double packedDotSimd(const float* a, const unsigned short* b, int n) {
+    const int W = sizeof(V) / sizeof(float);
+    V acc0 = {}, acc1 = {};
+    int i = 0;
+    for (; i + 2 * W <= n; i += 2 * W) {
+        V x0, y0, x1, y1;
+        __builtin_memcpy(&x0, a + i, sizeof(V));
+        widenPacked<V, IV, PV, F, HW>(b + i, y0);
+        __builtin_memcpy(&x1, a + i + W, sizeof(V));
+        widenPacked<V, IV, PV, F, HW>(b + i + W, y1);
+        acc0 += x0 * y0;
+        acc1 += x1 * y1;
+    }
+    acc0 += acc1;
+    double dotProduct = 0.0;
+    for (int j = 0; j < W; ++j) dotProduct += acc0[j];
+    for (; i < n; ++i) dotProduct += a[i] * widenScalar<F>(b[i]);
+    return dotProduct;
+}
+
+static double l1Simd4(const float* a, const float* b, int n) { return l1Simd<Float4, Int4>(a, b, n); }
+static double l2Simd4(const float* a, const float* b, int n) { return sqrt(l2SquaredSimd<Float4>(a, b, n)); }
+static double cosineSimd4(const float* a, const float* b, int n) { return cosineSimd<Float4>(a, b, n); }
+static double dotSimd4(const float* a, const float* b, int n) { return dotSimd<Float4>(a, b, n); }
+static double codeL1Simd4(const float* u, const float* s, const unsigned char* c, int n) { return codeL1Simd<Float4, Int4>(u, s, c, n); }
+static double codeDotSimd4(const float* w, const unsigned char* c, int n) { return codeDotSimd<Float4, Int4>(w, c, n); }
+static double fp16L1Simd4(const float* a, const unsigned short* b, int n) { return packedL1Simd<Float4, Int4, Packed4, FP16, false>(a, b, n); }
+static double fp16L2Simd4(const float* a, const unsigned short* b, int n) { return sqrt(packedL2SquaredSimd<Float4, Int4, Packed4, FP16, false>(a, b, n)); }
+static double fp16DotSimd4(const float* a, const unsigned short* b, int n) { return packedDotSimd<Float4, Int4, Packed4, FP16, false>(a, b, n); }
+static double bf16L1Simd4(const float* a, const unsigned short* b, int n) { return packedL1Simd<Float4, Int4, Packed4, BF16, false>(a, b, n); }
+static double bf16L2Simd4(const float* a, const unsigned short* b, int n) { return sqrt(packedL2SquaredSimd<Float4, Int4, Packed4, BF16, false>(a, b, n)); }
+static double bf16DotSimd4(const float* a, const unsigned short* b, int n) { return packedDotSimd<Float4, Int4, Packed4, BF16, false>(a, b, n); }
+
+#ifdef VECTORSTORE_SIMD_X86
+__attribute__((target("popcnt"))) static int hammingPopcnt(const unsigned long long* a, const unsigned long long* b, int words) {
+    int distance = 0;
+    for (int w = 0; w < words; ++w) distance += __builtin_popcountll(a[w] ^ b[w]);
+    return distance;
+}
+// The FMA target lets the compiler fuse the multiply-adds in the AVX2 copies
+__attribute__((target("avx2,fma"))) static double l1Simd8(const float* a, const float* b, int n) { return l1Simd<Float8, Int8>(a, b, n); }
+__attribute__((target("avx2,fma"))) static double l2Simd8(const float* a, const float* b, int n) { return sqrt(l2SquaredSimd<Float8>(a, b, n)); }
+__attribute__((target("avx2,fma"))) static double cosineSimd8(const float* a, const float* b, int n) { return cosineSimd<Float8>(a, b, n); }
+__attribute__((target("avx2,fma"))) static double dotSimd8(const float* a, const float* b, int n) { return dotSimd<Float8>(a, b, n); }
+__attribute__((target("avx2,fma"))) static double codeL1Simd8(const float* u, const float* s, const unsigned char* c, int n) { return codeL1Simd<Float8, Int8>(u, s, c, n); }
+__attribute__((target("avx2,fma"))) static double codeDotSimd8(const float* w, const unsigned char* c, int n) { return codeDotSimd<Float8, Int8>(w, c, n); }
+__attribute__((target("avx2,fma,f16c"))) static double fp16L1Simd8(const float* a, const unsigned short* b, int n) { return packedL1Simd<Float8, Int8, Packed8, FP16, true>(a, b, n); }
+__attribute__((target("avx2,fma,f16c"))) static double fp16L2Simd8(const float* a, const unsigned short* b, int n) { return sqrt(packedL2SquaredSimd<Float8, Int8, Packed8, FP16, true>(a, b, n)); }
+__attribute__((target("avx2,fma,f16c"))) static double fp16DotSimd8(const float* a, const unsigned short* b, int n) { return packedDotSimd<Float8, Int8, Packed8, FP16, true>(a, b, n); }
+__attribute__((target("avx2,fma"))) static double bf16L1Simd8(const float* a, const unsigned short* b, int n) { return packedL1Simd<Float8, Int8, Packed8, BF16, false>(a, b, n); }
+__attribute__((target("avx2,fma"))) static double bf16L2Simd8(const float* a, const unsigned short* b, int n) { return sqrt(packedL2SquaredSimd<Float8, Int8, Packed8, BF16, false>(a, b, n)); }
+__attribute__((target("avx2,fma"))) static double bf16DotSimd8(const float* a, const unsigned short* b, int n) { return packedDotSimd<Float8, Int8, Packed8, BF16, false>(a, b, n); }
+__attribute__((target("avx512f"))) static double l1Simd16(const float* a, const float* b, int n) { return l1Simd<Float16, Int16>(a, b, n); }
+__attribute__((target("avx512f"))) static double l2Simd16(const float* a, const float* b, int n) { return sqrt(l2SquaredSimd<Float16>(a, b, n)); }
+__attribute__((target("avx512f"))) static double cosineSimd16(const float* a, const float* b, int n) { return cosineSimd<Float16>(a, b, n); }
+__attribute__((target("avx512f"))) static double dotSimd16(const float* a, const float* b, int n) { return dotSimd<Float16>(a, b, n); }
+__attribute__((target("avx512f"))) static double codeL1Simd16(const float* u, const float* s, const unsigned char* c, int n) { return codeL1Simd<Float16, Int16>(u, s, c, n); }
+__attribute__((target("avx512f"))) static double codeDotSimd16(const float* w, const unsigned char* c, int n) { return codeDotSimd<Float16, Int16>(w, c, n); }
+__attribute__((target("avx512f"))) static double fp16L1Simd16(const float* a, const unsigned short* b, int n) { return packedL1Simd<Float16, Int16, Packed16, FP16, true>(a, b, n); }
+__attribute__((target("avx512f"))) static double fp16L2Simd16(const float* a, const unsigned short* b, int n) { return sqrt(packedL2SquaredSimd<Float16, Int16, Packed16, FP16, true>(a, b, n)); }
+__attribute__((target("avx512f"))) static double fp16DotSimd16(const float* a, const unsigned short* b, int n) { return packedDotSimd<Float16, Int16, Packed16, FP16, true>(a, b, n); }
+__attribute__((target("avx512f"))) static double bf16L1Simd16(const float* a, const unsigned short* b, int n) { return packedL1Simd<Float16, Int16, Packed16, BF16, false>(a, b, n); }
+__attribute__((target("avx512f"))) static double bf16L2Simd16(const float* a, const unsigned short* b, int n) { return sqrt(packedL2SquaredSimd<Float16, Int16, Packed16, BF16, false>(a, b, n)); }
+__attribute__((target("avx512f"))) static double bf16DotSimd16(const float* a, const unsigned short* b, int n) { return packedDotSimd<Float16, Int16, Packed16, BF16, false>(a, b, n); }
+#endif
+#endif // VECTORSTORE_SIMD
+
+// Kernels against rows stored in one 16-bit format
+struct PackedKernels {
+    double (*l1)(const float*, const unsigned short*, int);
+    double (*l2)(const float*, const unsigned short*, int);
+    double (*dot)(const float*, const unsigned short*, int);
+};
+
+struct DistanceKernels {
+    double (*l1)(const float*, const float*, int);
+    double (*l2)(const float*, const float*, int);
+    double (*cosine)(const float*, const float*, int);
+    double (*dot)(const float*, const float*, int);
+    double (*codeL1)(const float*, const float*, const unsigned char*, int);
+    double (*codeDot)(const float*, const unsigned char*, int);
+    int (*hamming)(const unsigned long long*, const unsigned long long*, int);
+    PackedKernels fp16;
+    PackedKernels bf16;
+    const char* name;
+};
+
+static DistanceKernels selectDistanceKernels() {
+    int (*hamming)(const unsigned long long*, const unsigned long long*, int) = hammingScalar;
+#if defined(VECTORSTORE_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt")) hamming = hammingPopcnt;
+    if (__builtin_cpu_supports("avx512f")) {
+        return DistanceKernels{ l1Simd16, l2Simd16, cosineSimd16, dotSimd16,
+                                codeL1Simd16, codeDotSimd16, hamming,
+                                { fp16L1Simd16, fp16L2Simd16, fp16DotSimd16 },
+                                { bf16L1Simd16, bf16L2Simd16, bf16DotSimd16 }, "avx512f" };
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        DistanceKernels kernels{ l1Simd8, l2Simd8, cosineSimd8, dotSimd8,
+                                 codeL1Simd8, codeDotSimd8, hamming,
+                                 { fp16L1Simd8, fp16L2Simd8, fp16DotSimd8 },
+                                 { bf16L1Simd8, bf16L2Simd8, bf16DotSimd8 }, "avx2+fma" };
+        if (!__builtin_cpu_supports("f16c")) {
+            kernels.fp16 = PackedKernels{ fp16L1Simd4, fp16L2Simd4, fp16DotSimd4 };
+        }
+        return kernels;
+    }
+#endif
+#if defined(VECTORSTORE_SIMD)
+    return DistanceKernels{ l1Simd4, l2Simd4, cosineSimd4, dotSimd4,
+                            codeL1Simd4, codeDotSimd4, hamming,
+                            { fp16L1Simd4, fp16L2Simd4, fp16DotSimd4 },
+                            { bf16L1Simd4, bf16L2Simd4, bf16DotSimd4 }, "simd128" };
+#else
+    return DistanceKernels{ l1Scalar, l2Scalar, cosineScalar, dotScalar,
+                            codeL1Scalar, codeDotScalar, hamming,
+                            { packedL1Scalar<FP16>, packedL2Scalar<FP16>, packedDotScalar<FP16> },
+                            { packedL1Scalar<BF16>, packedL2Scalar<BF16>, packedDotScalar<BF16> }, "scalar" };
+#endif
+}
+
+// Function-local static: initialized once (thread-safely) before first use,
+// even when the first VectorStore is built during static initialization
+static const DistanceKernels& distanceKernels() {
+    static const DistanceKernels kernels = selectDistanceKernels();
+    return kernels;
+}
+
+static double l1Kernel(const float* a, const float* b, int n) {
+    return distanceKernels().l1(a, b, n);
+}
+static double l2Kernel(const float* a, const float* b, int n) {
+    return distanceKernels().l2(a, b, n);
+}
+static double cosineKernel(const float* a, const float* b, int n) {
+    return distanceKernels().cosine(a, b, n);
+}
+static double dotKernel(const float* a, const float* b, int n) {
+    return distanceKernels().dot(a, b, n);
+}
+
 // =====================================
 // AVLTree<K, T> implementation
 // =====================================
@@ -70,6 +706,10 @@ void AVLTree<K, T>::printTreeStructure() const {
 template <class K, class T>
 AVLTree<K, T>::AVLTree() {
     root = nullptr;
+    rootPinned = false;
+    boundDims = 0;
+    pointOf = nullptr;
+    pointContext = nullptr;
 }
 
 template <class K, class T>
@@ -83,6 +723,8 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>:: rotateRight(AVLNode*& node) {
     AVLNode* pivot = node->pLeft;
     node->pLeft = pivot->pRight;
     pivot->pRight = node;
+    updateSize(node);
+    updateSize(pivot);
     return pivot;
 }
 template <class K, class T>
@@ -90,6 +732,8 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>:: rotateLeft(AVLNode*& node) {
     AVLNode* pivot = node->pRight;
     node->pRight = pivot->pLeft;
     pivot->pLeft = node;
+    updateSize(node);
+    updateSize(pivot);
     return pivot;
 }
 
@@ -145,13 +789,13 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::balanceRight(AVLNode*& node) {
         // Update balances based on grandchild's original balance
         if (grandChild->balance == LH) {
             node->balance = EH;
-            node->pLeft->balance = RH;
-            node->pRight->balance = EH;
+            node->pLeft->balance = EH;
+            node->pRight->balance = RH;
         } 
         else if (grandChild->balance == RH) {
             node->balance = EH;
-            node->pLeft->balance = EH;
-            node->pRight->balance = LH;
+            node->pLeft->balance = LH;
+            node->pRight->balance = EH;
         } 
         else { // grandChild was EH
             node->balance = EH;
@@ -167,12 +811,14 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::insertHelper(
 {
     if (node == nullptr) {
         node = new AVLNode(key, value); // Constructor sets balance = EH
+        if (boundDims > 0) updateBounds(node);
         taller = true;
         return node;
     }
 
     if (key < node->key) {
         node->pLeft = insertHelper(node->pLeft, key, value, taller);
+        updateSize(node);
 
         if (taller) { 
             // Update balance factor
@@ -190,6 +836,7 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::insertHelper(
     } 
     else if (key > node->key) {
         node->pRight = insertHelper(node->pRight, key, value, taller);
+        updateSize(node);
 
         if (taller) { 
             // Update balance factor
@@ -215,6 +862,16 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::insertHelper(
 template <class K, class T>
 void AVLTree<K, T>::insert(const K& key, const T& value) {
     bool taller = false;
+    if (rootPinned && root != nullptr && key != root->key) {
+        // Pinned root: only its subtrees grow and rebalance
+        if (key < root->key) {
+            root->pLeft = insertHelper(root->pLeft, key, value, taller);
+        } else {
+            root->pRight = insertHelper(root->pRight, key, value, taller);
+        }
+        updateSize(root);
+        return;
+    }
     this->root = insertHelper(this->root, key, value, taller);
 }
 
@@ -246,10 +903,10 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::balanceRight_Remove(AVLNode*& no
                 node->balance = EH; node->pLeft->balance = EH; node->pRight->balance = EH;
             } 
             else if (grandChild->balance == LH) {
-                node->balance = EH; node->pLeft->balance = RH; node->pRight->balance = EH;
+                node->balance = EH; node->pLeft->balance = EH; node->pRight->balance = RH;
             } 
             else { // grandChild->balance == RH
-                node->balance = EH; node->pLeft->balance = EH; node->pRight->balance = LH;
+                node->balance = EH; node->pLeft->balance = LH; node->pRight->balance = EH;
             }
             shorter = true;
         } 
@@ -321,6 +978,7 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::removeHelper(
     if (key < node->key) {
         // 1. Delete from LEFT subtree
         node->pLeft = removeHelper(node->pLeft, key, shorter, success);
+        updateSize(node);
         if (shorter) {
             // Left subtree shrunk, rebalance this node
             node = balanceRight_Remove(node, shorter); 
@@ -329,6 +987,7 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::removeHelper(
     else if (key > node->key) {
         // 2. Delete from RIGHT subtree
         node->pRight = removeHelper(node->pRight, key, shorter, success);
+        updateSize(node);
         if (shorter) {
             // Right subtree shrunk, rebalance this node
             node = balanceLeft_Remove(node, shorter);
@@ -340,13 +999,13 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::removeHelper(
         if (node->pLeft == nullptr) {
             // Case 1: 0 or 1 child (right)
             AVLNode* temp = node->pRight;
-            delete node;
+            deleteNode(node);
             node = temp;
             shorter = true; // This subtree is now shorter
         } else if (node->pRight == nullptr) {
             // Case 2: 1 child (left)
             AVLNode* temp = node->pLeft;
-            delete node;
+            deleteNode(node);
             node = temp;
             shorter = true;
         } else {
@@ -358,6 +1017,7 @@ typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::removeHelper(
             node->data = successor->data;
             
             node->pRight = removeHelper(node->pRight, successor->key, shorter, success);
+            updateSize(node);
             
             if (shorter) {
                 node = balanceLeft_Remove(node, shorter);
@@ -371,6 +1031,31 @@ template <class K, class T>
 void AVLTree<K, T>::remove(const K& key) {
     bool shorter = false;
     bool success = false;
+    if (rootPinned && root != nullptr) {
+        if (key < root->key) {
+            root->pLeft = removeHelper(root->pLeft, key, shorter, success);
+        }
+        else if (key > root->key) {
+            root->pRight = removeHelper(root->pRight, key, shorter, success);
+        }
+        else if (root->pRight) {
+            // Removing the pinned root itself: its successor takes its place on top
+            AVLNode* successor = findMin(root->pRight);
+            root->key = successor->key;
+            root->data = successor->data;
+            root->pRight = removeHelper(root->pRight, root->key, shorter, success);
+        }
+        else {
+            // No right subtree: the left child (an AVL subtree) becomes the tree
+            AVLNode* left = root->pLeft;
+            deleteNode(root);
+            root = left;
+            rootPinned = false;
+            return;
+        }
+        updateSize(root);
+        return;
+    }
     this->root = removeHelper(this->root, key, shorter, success);
 }
 
@@ -424,10 +1109,13 @@ int AVLTree<K,T>:: getSizeHelper(AVLNode* node) const {
 }
 template <class K, class T>
 int AVLTree<K, T>::getSize() const {
-    if (root == nullptr) {
-        return 0;
+    // The root's subtree size is the element count: O(1)
+#ifdef VECTORSTORE_DEBUG
+    if (sizeOf(root) != getSizeHelper(root)) {
+        throw logic_error("AVLTree size out of sync with node count");
     }
-    return getSizeHelper(root);
+#endif
+    return sizeOf(root);
 }
 
 // CLEAR
@@ -443,6 +1131,9 @@ template <class K, class T>
 void AVLTree<K, T>::clear() {
     clearHelper(root);
     root = nullptr;
+    rootPinned = false;
+    boxes.clear();
+    freeBoxes.clear();
 }
 
 // EMPTY
@@ -465,6 +1156,284 @@ void AVLTree<K, T>::inorderTraversal(void (*action)(const T&)) const {
     inorderHelper(root, action);
 }
 
+// BULK BUILD
+// Builds a height-balanced subtree from entries [l, r]; `height` receives its height
+template <class K, class T>
+typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::buildBalancedFromRange(
+    const vector<K>& keys, const vector<T>& values, int l, int r, int& height)
+{
+    if (l > r) {
+        height = 0;
+        return nullptr;
+    }
+    int mid = (l + r) / 2;
+    int leftHeight, rightHeight;
+    AVLNode* node = new AVLNode(keys[mid], values[mid]);
+    node->pLeft = buildBalancedFromRange(keys, values, l, mid - 1, leftHeight);
+    node->pRight = buildBalancedFromRange(keys, values, mid + 1, r, rightHeight);
+    // Midpoint split: the right half is never smaller, so heights differ by at most one
+    node->balance = (rightHeight > leftHeight) ? RH : EH;
+    node->size = r - l + 1;
+    if (boundDims > 0) updateBounds(node);
+    height = 1 + max(leftHeight, rightHeight);
+    return node;
+}
+template <class K, class T>
+void AVLTree<K, T>::buildFromSorted(const vector<K>& keys, const vector<T>& values) {
+    clear();
+    int height;
+    root = buildBalancedFromRange(keys, values, 0, (int)keys.size() - 1, height);
+}
+template <class K, class T>
+void AVLTree<K, T>::collectInorder(AVLNode* node, vector<K>& keys, vector<T>& values) const {
+    if (!node) return;
+    collectInorder(node->pLeft, keys, values);
+    keys.push_back(node->key);
+    values.push_back(node->data);
+    collectInorder(node->pRight, keys, values);
+}
+template <class K, class T>
+void AVLTree<K, T>::collectSorted(vector<K>& keys, vector<T>& values) const {
+    keys.reserve(keys.size() + sizeOf(root));
+    values.reserve(values.size() + sizeOf(root));
+    collectInorder(root, keys, values);
+}
+
+// RE-ROOTING
+// Nodes keep balance factors, not heights: follow the taller side down, O(log n)
+template <class K, class T>
+int AVLTree<K, T>::heightOf(AVLNode* node) const {
+    int height = 0;
+    while (node) {
+        height++;
+        node = (node->balance == LH) ? node->pLeft : node->pRight;
+    }
+    return height;
+}
+// Balance factor, size and bounds from the node's (already valid) children
+template <class K, class T>
+void AVLTree<K, T>::refreshNode(AVLNode* node) {
+    int leftHeight = heightOf(node->pLeft), rightHeight = heightOf(node->pRight);
+    node->balance = (rightHeight > leftHeight) ? RH : (rightHeight < leftHeight ? LH : EH);
+    updateSize(node);
+}
+// AVL tree of left, middle, right (every key of left < middle's < every key
+// of right), each of left / right an AVL tree: O(|height difference| log n)
+template <class K, class T>
+typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::join(AVLNode* left, AVLNode* middle, AVLNode* right) {
+    int leftHeight = heightOf(left), rightHeight = heightOf(right);
+    if (leftHeight > rightHeight + 1) return joinRight(left, middle, right);
+    if (rightHeight > leftHeight + 1) return joinLeft(left, middle, right);
+    middle->pLeft = left;
+    middle->pRight = right;
+    refreshNode(middle);
+    return middle;
+}
+// left is more than one taller: hang middle + right off its right spine
+template <class K, class T>
+typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::joinRight(AVLNode* left, AVLNode* middle, AVLNode* right) {
+    AVLNode* spine = left->pRight;
+    if (heightOf(spine) <= heightOf(right) + 1) {
+        middle->pLeft = spine;
+        middle->pRight = right;
+        refreshNode(middle);
+        left->pRight = middle;
+        if (heightOf(middle) > heightOf(left->pLeft) + 1) {
+            // Right-left case: middle's left child comes up between them
+            left->pRight = rotateRight(middle);
+            refreshNode(left->pRight->pRight);
+            refreshNode(left->pRight);
+            AVLNode* top = rotateLeft(left);
+            refreshNode(top->pLeft);
+            refreshNode(top);
+            return top;
+        }
+        refreshNode(left);
+        return left;
+    }
+    left->pRight = joinRight(spine, middle, right);
+    if (heightOf(left->pRight) > heightOf(left->pLeft) + 1) {
+        AVLNode* top = rotateLeft(left);
+        refreshNode(top->pLeft);
+        refreshNode(top);
+        return top;
+    }
+    refreshNode(left);
+    return left;
+}
+// Mirror of joinRight: right is more than one taller
+template <class K, class T>
+typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::joinLeft(AVLNode* left, AVLNode* middle, AVLNode* right) {
+    AVLNode* spine = right->pLeft;
+    if (heightOf(spine) <= heightOf(left) + 1) {
+        middle->pLeft = left;
+        middle->pRight = spine;
+        refreshNode(middle);
+        right->pLeft = middle;
+        if (heightOf(middle) > heightOf(right->pRight) + 1) {
+            right->pLeft = rotateLeft(middle);
+            refreshNode(right->pLeft->pLeft);
+            refreshNode(right->pLeft);
+            AVLNode* top = rotateRight(right);
+            refreshNode(top->pRight);
+            refreshNode(top);
+            return top;
+        }
+        refreshNode(right);
+        return right;
+    }
+    right->pLeft = joinLeft(left, middle, spine);
+    if (heightOf(right->pLeft) > heightOf(right->pRight) + 1) {
+        AVLNode* top = rotateRight(right);
+        refreshNode(top->pRight);
+        refreshNode(top);
+        return top;
+    }
+    refreshNode(right);
+    return right;
+}
+// Splits an AVL tree into the AVL trees of the keys below and above `key`;
+// found receives the node holding key (detached), or nullptr
+template <class K, class T>
+void AVLTree<K, T>::split(AVLNode* node, const K& key, AVLNode*& left, AVLNode*& found, AVLNode*& right) {
+    if (!node) {
+        left = found = right = nullptr;
+        return;
+    }
+    AVLNode* nodeLeft = node->pLeft;
+    AVLNode* nodeRight = node->pRight;
+    if (key < node->key) {
+        AVLNode* between;
+        split(nodeLeft, key, left, found, between);
+        right = join(between, node, nodeRight);
+    } else if (key > node->key) {
+        AVLNode* between;
+        split(nodeRight, key, between, found, right);
+        left = join(nodeLeft, node, between);
+    } else {
+        left = nodeLeft;
+        right = nodeRight;
+        found = node;
+    }
+}
+template <class K, class T>
+bool AVLTree<K, T>::pinRoot(const K& key) {
+    if (!root || !contains(key)) return false;
+    if (root->key == key) {
+        rootPinned = true;
+        return true;
+    }
+    // A pinned root may be lopsided: join it back into one AVL tree first
+    AVLNode* whole = rootPinned ? join(root->pLeft, root, root->pRight) : root;
+    AVLNode *left, *found, *right;
+    split(whole, key, left, found, right);
+    found->pLeft = left;
+    found->pRight = right;
+    refreshNode(found);
+    root = found;
+    rootPinned = true;
+    return true;
+}
+
+// SUBTREE BOUNDS
+// The node's own point widened by its children's boxes, which must be current.
+// A node without a box gets one here: a freed entry, or a new one at the end.
+template <class K, class T>
+void AVLTree<K, T>::updateBounds(AVLNode* node) {
+    if (node->box == -1) {
+        if (!freeBoxes.empty()) {
+            node->box = freeBoxes.back();
+            freeBoxes.pop_back();
+        } else {
+            node->box = (int)(boxes.size() / (2 * boundDims));
+            boxes.resize(boxes.size() + 2 * boundDims);
+        }
+    }
+    float* low = &boxes[(size_t)node->box * 2 * boundDims];
+    float* high = low + boundDims;
+    const float* own = pointOf(node->data, pointContext);
+    for (int i = 0; i < boundDims; ++i) low[i] = high[i] = own[i];
+    for (AVLNode* child : {node->pLeft, node->pRight}) {
+        if (!child) continue;
+        const float* childLow = boundsOf(child);
+        const float* childHigh = childLow + boundDims;
+        for (int i = 0; i < boundDims; ++i) {
+            if (childLow[i] < low[i]) low[i] = childLow[i];
+            if (childHigh[i] > high[i]) high[i] = childHigh[i];
+        }
+    }
+}
+template <class K, class T>
+void AVLTree<K, T>::refreshBoundsHelper(AVLNode* node) {
+    if (!node) return;
+    refreshBoundsHelper(node->pLeft);
+    refreshBoundsHelper(node->pRight);
+    if (boundDims > 0) updateBounds(node);
+}
+// Drops a node removed from the tree; its box is kept for the next node
+template <class K, class T>
+void AVLTree<K, T>::deleteNode(AVLNode* node) {
+    if (node->box != -1) freeBoxes.push_back(node->box);
+    delete node;
+}
+template <class K, class T>
+void AVLTree<K, T>::clearBoxes(AVLNode* node) {
+    if (!node) return;
+    node->box = -1;
+    clearBoxes(node->pLeft);
+    clearBoxes(node->pRight);
+}
+template <class K, class T>
+void AVLTree<K, T>::setBounds(int dims, const float* (*pointOf)(const T&, const void*), const void* context) {
+    this->boundDims = dims;
+    this->pointOf = pointOf;
+    this->pointContext = context;
+    // Box sizes change with dims: hand every node a fresh entry
+    vector<float>().swap(boxes);
+    freeBoxes.clear();
+    clearBoxes(root);
+    refreshBoundsHelper(root);
+}
+template <class K, class T>
+void AVLTree<K, T>::refreshBounds() {
+    refreshBoundsHelper(root);
+}
+
+// ORDER STATISTICS
+template <class K, class T>
+typename AVLTree<K, T>::AVLNode* AVLTree<K, T>::select(int rank) const {
+    AVLNode* node = root;
+    while (node) {
+        int leftSize = sizeOf(node->pLeft);
+        if (rank < leftSize) {
+            node = node->pLeft;
+        }
+        else if (rank > leftSize) {
+            rank -= leftSize + 1;
+            node = node->pRight;
+        }
+        else {
+            return node;
+        }
+    }
+    return nullptr; // rank out of range
+}
+template <class K, class T>
+int AVLTree<K, T>::rank(const K& key) const {
+    AVLNode* node = root;
+    int smaller = 0;
+    while (node) {
+        if (key <= node->key) {
+            node = node->pLeft;
+        }
+        else {
+            smaller += sizeOf(node->pLeft) + 1;
+            node = node->pRight;
+        }
+    }
+    return smaller;
+}
+
 
 // =====================================
 // RedBlackTree<K, T> implementation
@@ -566,6 +1535,7 @@ void RedBlackTree<K, T>::RBTNode::recolorToBlack() {
 template <class K, class T>
 RedBlackTree<K, T>::RedBlackTree() {
     root = nullptr;
+    nodeCount = 0;
 }
 template <class K, class T>
 RedBlackTree<K, T>::~RedBlackTree() {
@@ -663,10 +1633,12 @@ int RedBlackTree<K, T>::getSize(RBTNode* node) const{
 }
 template <class K, class T>
 int RedBlackTree<K, T>:: size() const {
-    if (root == nullptr) {
-        return 0;
+#ifdef VECTORSTORE_DEBUG
+    if (nodeCount != getSize(root)) {
+        throw logic_error("RedBlackTree size out of sync with node count");
     }
-    return getSize(root);
+#endif
+    return nodeCount;
 }
 
 // CLEAR
@@ -682,6 +1654,7 @@ template <class K, class T>
 void RedBlackTree<K,T>:: clear(){
     clearHelper(root);
     root = nullptr;
+    nodeCount = 0;
 }
 
 // INSERT
@@ -707,6 +1680,7 @@ void RedBlackTree<K, T>::fixInsert(RBTNode* node) {
                 if (node == parent->right) {
                     node = parent;
                     rotateLeft(node);
+                    parent = node->parent;
                 }
                 // Case 1C: node is left child → rotate right
                 parent->recolorToBlack();
@@ -730,6 +1704,7 @@ void RedBlackTree<K, T>::fixInsert(RBTNode* node) {
                 if (node == parent->left) {
                     node = parent;
                     rotateRight(node);
+                    parent = node->parent;
                 }
                 // Case 2C: node is right child → rotate left
                 parent->recolorToBlack();
@@ -749,6 +1724,7 @@ void RedBlackTree<K, T>:: insert(const K& key, const T& value) {
     if(root == nullptr){
         newNode->recolorToBlack();
         root = newNode;
+        nodeCount = 1;
         return;
     }
     else{
@@ -775,6 +1751,7 @@ void RedBlackTree<K, T>:: insert(const K& key, const T& value) {
             parent->right = newNode;
         }
     }
+    nodeCount++;
     fixInsert(newNode);
 }
 
@@ -947,6 +1924,7 @@ void RedBlackTree<K, T>::remove(const K& key) {
     }
 
     delete node;
+    nodeCount--;
 
     // If deleted node was black, fix double-black violation
     if (originalColor == Color::BLACK)
@@ -1010,6 +1988,49 @@ typename RedBlackTree<K, T>::RBTNode* RedBlackTree<K, T>::upperBound(const K& ke
     return res;
 }
 
+// BULK BUILD
+// Midpoint splits put every missing child on the last two levels, so colouring
+// exactly the nodes on the deepest level (redDepth) red gives every path the
+// same number of black nodes, and no red node has a red child.
+template <class K, class T>
+typename RedBlackTree<K, T>::RBTNode* RedBlackTree<K, T>::buildFromRange(
+    const vector<K>& keys, const vector<T>& values, int l, int r, int depth, int redDepth)
+{
+    if (l > r) return nullptr;
+    int mid = (l + r) / 2;
+    RBTNode* node = new RBTNode(keys[mid], values[mid]);
+    node->color = (depth == redDepth && depth > 0) ? RED : BLACK;
+
+    node->left = buildFromRange(keys, values, l, mid - 1, depth + 1, redDepth);
+    node->right = buildFromRange(keys, values, mid + 1, r, depth + 1, redDepth);
+    if (node->left) node->left->parent = node;
+    if (node->right) node->right->parent = node;
+    return node;
+}
+template <class K, class T>
+void RedBlackTree<K, T>::buildFromSorted(const vector<K>& keys, const vector<T>& values) {
+    clear();
+    int n = (int)keys.size();
+    int redDepth = 0; // floor(log2(n)): depth of the deepest level
+    while ((2 << redDepth) <= n) redDepth++;
+    root = buildFromRange(keys, values, 0, n - 1, 0, redDepth);
+    nodeCount = n;
+}
+template <class K, class T>
+void RedBlackTree<K, T>::collectInorder(RBTNode* node, vector<K>& keys, vector<T>& values) const {
+    if (!node) return;
+    collectInorder(node->left, keys, values);
+    keys.push_back(node->key);
+    values.push_back(node->data);
+    collectInorder(node->right, keys, values);
+}
+template <class K, class T>
+void RedBlackTree<K, T>::collectSorted(vector<K>& keys, vector<T>& values) const {
+    keys.reserve(keys.size() + nodeCount);
+    values.reserve(values.size() + nodeCount);
+    collectInorder(root, keys, values);
+}
+
 // =====================================
 // VectorRecord implementation
 // =====================================
@@ -1021,639 +2042,2997 @@ std::ostream& operator<<(std::ostream& os, const VectorRecord& record) {
 }
 
 // =====================================
-// VectorStore implementation
+// IdIndex implementation
 // =====================================
 
-//TODO: Implement all VectorStore methods here
+IdIndex::IdIndex() {
+    capacity = 16;
+    keys = new int[capacity];
+    values = new int[capacity];
+    for (int i = 0; i < capacity; ++i) keys[i] = EMPTY_KEY;
+    used = 0;
+    live = 0;
+}
 
-//CONSTRUCTOR
-VectorStore::VectorStore( int dimension, 
-    vector<float>* (*embeddingFunction)(const string&),
-    const vector<float>& referenceVector){
-    
-    this->dimension = dimension;
-    this->embeddingFunction = embeddingFunction;
-    this->count = 0;
-    this->averageDistance = 0.0;
-
-    // Allocate the trees (empty)
-    this->vectorStore = new AVLTree<double, VectorRecord>();        //avl
-    this->normIndex   = new RedBlackTree<double, VectorRecord>();   //rbt
-
-    // Copy reference vector
-    this->referenceVector = new vector<float>(referenceVector);
+IdIndex::~IdIndex() {
+    delete[] keys;
+    delete[] values;
+}
 
-    // No root vector yet
-    this->rootVector = nullptr;     //root vector of avl
+// Fibonacci hashing spreads consecutive ids over the table
+int IdIndex::bucketFor(int id) const {
+    unsigned int h = static_cast<unsigned int>(id) * 2654435769u;
+    return static_cast<int>(h & static_cast<unsigned int>(capacity - 1));
 }
-// DESRUCTOR
-VectorStore::~VectorStore()
-{
-    // Clear all AVL and Red-Black tree contents
-    if (vectorStore) {
-        vectorStore->clear();
-        delete vectorStore;
-        vectorStore = nullptr;
-    }
 
-    if (normIndex) {
-        normIndex->clear();
-        delete normIndex;
-        normIndex = nullptr;
+void IdIndex::rehash(int newCapacity) {
+    int* oldKeys = keys;
+    int* oldValues = values;
+    int oldCapacity = capacity;
+
+    capacity = newCapacity;
+    keys = new int[capacity];
+    values = new int[capacity];
+    for (int i = 0; i < capacity; ++i) keys[i] = EMPTY_KEY;
+    used = 0;
+    live = 0;
+
+    // Re-insert live entries only; tombstones are dropped here
+    for (int i = 0; i < oldCapacity; ++i) {
+        if (oldKeys[i] >= 0) insert(oldKeys[i], oldValues[i]);
     }
+    delete[] oldKeys;
+    delete[] oldValues;
+}
 
-    // Delete rootVector and referenceVector
-    if (rootVector) {
-        delete rootVector;
-        rootVector = nullptr;
+void IdIndex::insert(int id, int slot) {
+    // Keep the load (including tombstones) at or below one half
+    if ((used + 1) * 2 > capacity) {
+        rehash(live * 2 + 2 > capacity ? capacity * 2 : capacity);
     }
 
-    if (referenceVector) {
-        delete referenceVector;
-        referenceVector = nullptr;
+    int i = bucketFor(id);
+    int firstTombstone = -1;
+    while (keys[i] != EMPTY_KEY) {
+        if (keys[i] == id) {        // overwrite existing mapping
+            values[i] = slot;
+            return;
+        }
+        if (keys[i] == TOMBSTONE_KEY && firstTombstone == -1) firstTombstone = i;
+        i = (i + 1) & (capacity - 1);
     }
+    if (firstTombstone != -1) {
+        i = firstTombstone;         // reuse the tombstone, `used` does not change
+    } else {
+        used++;
+    }
+    keys[i] = id;
+    values[i] = slot;
+    live++;
 }
 
-//SIZE
-int VectorStore::size() {
-    return this->count;
-}
-
-//EMPTY
-bool VectorStore::empty(){
-    return this->count == 0;
+int IdIndex::find(int id) const {
+    if (id < 0) return -1;
+    int i = bucketFor(id);
+    while (keys[i] != EMPTY_KEY) {
+        if (keys[i] == id) return values[i];
+        i = (i + 1) & (capacity - 1);
+    }
+    return -1;
 }
 
-//CLEAR
-void VectorStore::clear(){
-    if(vectorStore) vectorStore->clear(); // clear avl
-    if(normIndex)   normIndex->clear(); // clear RBT
-    this->count = 0;
-    this->averageDistance = 0.0;
-    
-    if(rootVector){
-        delete rootVector;
-        rootVector = nullptr;
+bool IdIndex::erase(int id) {
+    if (id < 0) return false;
+    int i = bucketFor(id);
+    while (keys[i] != EMPTY_KEY) {
+        if (keys[i] == id) {
+            keys[i] = TOMBSTONE_KEY;
+            live--;
+            return true;
+        }
+        i = (i + 1) & (capacity - 1);
     }
+    return false;
 }
-// PREPROCESSING AND DATA MANAGEMENT
 
-vector<float>* VectorStore::preprocessing(string rawText) {
-    // Call embeddingFunction to map the text to a vector
-    vector<float>* vec = embeddingFunction(rawText);
-    if (!vec) return nullptr;
+void IdIndex::clear() {
+    for (int i = 0; i < capacity; ++i) keys[i] = EMPTY_KEY;
+    used = 0;
+    live = 0;
+}
 
-    // if size > dimension -> truncate trailing
-    if (vec->size() > static_cast<size_t>(dimension)) {
-        vec->resize(dimension);
-    }
+// =====================================
+// HNSWIndex implementation
+// =====================================
 
-    // if size < dimension -> pad with 0's
-    else if (vec->size() < static_cast<size_t>(dimension)) {
-        vec->insert(vec->end(), dimension - vec->size(), 0.0f);
+// Distance used inside the index structures: smaller is closer for every
+// metric, so cosine becomes 1 - similarity
+static double indexDistance(Metric metric, const float* a, const float* b, int n) {
+    switch (metric) {
+        case EUCLIDEAN: return l2Kernel(a, b, n);
+        case MANHATTAN: return l1Kernel(a, b, n);
+        case COSINE:    return 1.0 - cosineKernel(a, b, n);
     }
-
-    // Return the normalized vector
-    return vec;
+    return 0.0;
 }
 
-void VectorStore::addText(string rawText) {
-    
-    // use preprocessing to convert text into a vector.
-    vector<float>* newVec = this->preprocessing(rawText);
-    if (newVec == nullptr) {
-        return; 
-    }
+// xorshift64* step: the index structures' own deterministic generator
+static unsigned long long nextRandom(unsigned long long& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
 
-    // Compute distance from the reference vector.
-    // for the AVL Tree
-    double distFromRef = l2Distance(*newVec, *this->referenceVector);
+HNSWIndex::HNSWIndex(Metric metric, int dimension, int M, int efConstruction) {
+    this->metric = metric;
+    this->dimension = dimension;
+    this->M = M < 2 ? 2 : M;
+    this->maxM0 = 2 * this->M;
+    this->efConstruction = efConstruction < this->M ? this->M : efConstruction;
+    this->levelScale = 1.0 / log((double)this->M);
+    this->rngState = 0x9E3779B97F4A7C15ULL; // fixed seed: same inserts, same graph
+    this->entryPoint = -1;
+    this->maxLevel = -1;
+    this->nodeCount = 0;
+    this->deletedCount = 0;
+    this->visitEpoch = 0;
+}
 
-    // Update the average distance.
-    double totalDistance = (this->averageDistance * this->count) + distFromRef;
-    int old_count = this->count;
-    this->count++; 
-    this->averageDistance = totalDistance / this->count;
+double HNSWIndex::distance(const float* a, const float* b) const {
+    return indexDistance(metric, a, b, dimension);
+}
 
-    // Compute the "Euclidean norm" of the vector.
-    // for the Red-Black Tree
-    double vecNorm = 0.0;
-    for (float val : *newVec) {
-        vecNorm += val * val;
-    }
-    vecNorm = sqrt(vecNorm);
+int* HNSWIndex::linksOf(int slot, int level) {
+    if (level == 0) return &level0[(size_t)slot * (maxM0 + 1)];
+    return &upper[slot][(size_t)(level - 1) * (M + 1)];
+}
+const int* HNSWIndex::linksOf(int slot, int level) const {
+    if (level == 0) return &level0[(size_t)slot * (maxM0 + 1)];
+    return &upper[slot][(size_t)(level - 1) * (M + 1)];
+}
 
-    // newID = current max id + 1
-    int maxId = -1;
-    if (old_count > 0) {
-        // use AVL to traverse
+// Level with P(level >= l) = M^-l
+int HNSWIndex::randomLevel() {
+    unsigned long long bits = nextRandom(rngState) >> 11;                // 53 random bits
+    double uniform = (bits + 1.0) / 9007199254740993.0;                 // (0, 1]
+    return (int)(-log(uniform) * levelScale);
+}
 
-        queue<AVLTree<double, VectorRecord>::AVLNode*> q;
-        q.push(this->vectorStore->root); 
+void HNSWIndex::reserveSlot(int slot) {
+    if (slot < (int)levels.size()) return;
+    size_t newSize = levels.size() > 0 ? levels.size() * 2 : 16;
+    if (newSize <= (size_t)slot) newSize = slot + 1;
+    levels.resize(newSize, -1);
+    deleted.resize(newSize, 0);
+    level0.resize(newSize * (maxM0 + 1), 0);
+    upper.resize(newSize);
+    visitTag.resize(newSize, 0);
+}
 
-        while(!q.empty()) {
-            AVLTree<double, VectorRecord>::AVLNode* node = q.front();
-            q.pop();
-            
-            if(node == nullptr) continue;
+void HNSWIndex::nextVisitEpoch() {
+    if (++visitEpoch == 0) { // wrapped: forget every old mark
+        for (unsigned& tag : visitTag) tag = 0;
+        visitEpoch = 1;
+    }
+}
 
-            if (node->data.id > maxId) {
-                maxId = node->data.id;
+// Greedy descent on one level: move to a closer neighbor until there is none
+int HNSWIndex::greedyClosest(const float* query, int start, int level, const float* arena, int& evaluated) {
+    int current = start;
+    double currentDistance = distance(query, arena + (size_t)current * dimension);
+    evaluated++;
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        const int* links = linksOf(current, level);
+        for (int i = 1; i <= links[0]; ++i) {
+            double d = distance(query, arena + (size_t)links[i] * dimension);
+            evaluated++;
+            if (d < currentDistance) {
+                currentDistance = d;
+                current = links[i];
+                moved = true;
             }
-            
-            if(node->pLeft) q.push(node->pLeft);
-            if(node->pRight) q.push(node->pRight);
         }
     }
-    int newId = maxId + 1;
+    return current;
+}
 
-    // Create the new record
-    VectorRecord newRecord(newId, rawText, newVec, distFromRef);
-    newRecord.norm = vecNorm;
+// Best-first search of one level from the entry points, keeping the ef
+// closest nodes seen. With liveOnly, tombstoned nodes are still expanded but
+// not kept. `found` receives (distance, slot) pairs, closest first.
+void HNSWIndex::searchLayer(const float* query, const vector<pair<double, int>>& entries, int ef, int level,
+                            bool liveOnly, const float* arena, vector<pair<double, int>>& found, int& evaluated) {
+    nextVisitEpoch();
+    // candidates: closest on top; kept: farthest on top
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> candidates;
+    priority_queue<pair<double, int>> kept;
+    for (const pair<double, int>& entry : entries) {
+        visitTag[entry.second] = visitEpoch;
+        candidates.push(entry);
+        if (!liveOnly || !deleted[entry.second]) kept.push(entry);
+    }
+    while ((int)kept.size() > ef) kept.pop();
+
+    while (!candidates.empty()) {
+        pair<double, int> closest = candidates.top();
+        if ((int)kept.size() >= ef && closest.first > kept.top().first) break; // nothing closer is left
+        candidates.pop();
+
+        const int* links = linksOf(closest.second, level);
+        for (int i = 1; i <= links[0]; ++i) {
+            int next = links[i];
+            if (visitTag[next] == visitEpoch) continue;
+            visitTag[next] = visitEpoch;
+
+            double d = distance(query, arena + (size_t)next * dimension);
+            evaluated++;
+            if ((int)kept.size() < ef || d < kept.top().first) {
+                candidates.push({d, next});
+                if (!liveOnly || !deleted[next]) {
+                    kept.push({d, next});
+                    if ((int)kept.size() > ef) kept.pop();
+                }
+            }
+        }
+    }
 
-    bool rebuild = false;
-    // If the store is empty, sets this vector as the root vector.
-    if (old_count == 0) {
-        this->rootVector = new VectorRecord(newRecord);
-        // no need to rebuild when first inserted
-    } 
-    else {
-        // Check if new vector's distance is closer to the average
-        double rootDistToAvg = fabs(this->rootVector->distanceFromReference - this->averageDistance);
-        double newDistToAvg = fabs(newRecord.distanceFromReference - this->averageDistance);
+    found.resize(kept.size());
+    for (int i = (int)kept.size() - 1; i >= 0; --i) {
+        found[i] = kept.top();
+        kept.pop();
+    }
+}
 
-        if (newDistToAvg < rootDistToAvg) {
-            delete this->rootVector;
-            this->rootVector = new VectorRecord(newRecord);
-            rebuild = true; // mark that we must reconstruct AVL so that this becomes the AVL root
+// Neighbor selection heuristic: walk candidates closest first and keep one
+// only if it is closer to the new node than to every neighbor kept so far,
+// which spreads links across directions instead of into one cluster
+void HNSWIndex::selectNeighbors(const vector<pair<double, int>>& candidates, int maxLinks,
+                                const float* arena, vector<int>& chosen) const {
+    chosen.clear();
+    for (const pair<double, int>& candidate : candidates) {
+        if ((int)chosen.size() >= maxLinks) break;
+        const float* row = arena + (size_t)candidate.second * dimension;
+        bool diverse = true;
+        for (int kept : chosen) {
+            if (distance(row, arena + (size_t)kept * dimension) < candidate.first) {
+                diverse = false;
+                break;
+            }
         }
+        if (diverse) chosen.push_back(candidate.second);
     }
+}
 
-    // insert vector into AVL and RBT first (so the trees contain the new record)
-    this->vectorStore->insert(distFromRef, newRecord);
-    this->normIndex->insert(newRecord.norm, newRecord);
+void HNSWIndex::setLinks(int slot, int level, const vector<int>& links) {
+    int* target = linksOf(slot, level);
+    target[0] = (int)links.size();
+    for (size_t i = 0; i < links.size(); ++i) target[i + 1] = links[i];
+}
 
-    // If rootVector changed, rebuild AVL so that the selected rootVector becomes the actual AVL root
-    if (rebuild) {
-        rebuildTreeWithNewRoot(this->rootVector);
+// Adds the edge from -> to; a full list is re-pruned with the heuristic
+void HNSWIndex::addLink(int from, int to, int level, const float* arena) {
+    int maxLinks = (level == 0) ? maxM0 : M;
+    int* links = linksOf(from, level);
+    if (links[0] < maxLinks) {
+        links[++links[0]] = to;
+        return;
     }
+    const float* row = arena + (size_t)from * dimension;
+    vector<pair<double, int>> candidates;
+    candidates.reserve(links[0] + 1);
+    candidates.push_back({distance(row, arena + (size_t)to * dimension), to});
+    for (int i = 1; i <= links[0]; ++i) {
+        candidates.push_back({distance(row, arena + (size_t)links[i] * dimension), links[i]});
+    }
+    // Insertion sort: at most maxM0 + 1 entries
+    for (size_t i = 1; i < candidates.size(); ++i) {
+        pair<double, int> item = candidates[i];
+        size_t j = i;
+        while (j > 0 && item < candidates[j - 1]) {
+            candidates[j] = candidates[j - 1];
+            --j;
+        }
+        candidates[j] = item;
+    }
+    vector<int> chosen;
+    selectNeighbors(candidates, maxLinks, arena, chosen);
+    setLinks(from, level, chosen);
 }
 
-// helper for finding vector at given index with INORDER Traversal
-static VectorRecord* getNthRecordInorder(AVLTree<double, VectorRecord>::AVLNode* node, 
-    int& counter, int targetIndex) {
-
-    if (node == nullptr) {
-        return nullptr;
+void HNSWIndex::insert(int slot, const float* arena) {
+    reserveSlot(slot);
+    int level = randomLevel();
+    levels[slot] = level;
+    deleted[slot] = 0;
+    linksOf(slot, 0)[0] = 0;
+    upper[slot].assign((size_t)level * (M + 1), 0);
+    nodeCount++;
+
+    if (entryPoint == -1) {
+        entryPoint = slot;
+        maxLevel = level;
+        return;
     }
 
-    //Traverse Left Subtree
-    VectorRecord* result = getNthRecordInorder(node->pLeft, counter, targetIndex);
-    if (result != nullptr) {
-        return result; 
+    const float* query = arena + (size_t)slot * dimension;
+    int evaluated = 0;
+    int current = entryPoint;
+    for (int l = maxLevel; l > level; --l) {
+        current = greedyClosest(query, current, l, arena, evaluated);
     }
 
-    //Visit Current Node
-    if (counter == targetIndex) {
-        return &(node->data); 
+    vector<pair<double, int>> entries(1, {distance(query, arena + (size_t)current * dimension), current});
+    vector<pair<double, int>> found;
+    vector<int> chosen;
+    for (int l = (level < maxLevel ? level : maxLevel); l >= 0; --l) {
+        searchLayer(query, entries, efConstruction, l, false, arena, found, evaluated);
+        selectNeighbors(found, M, arena, chosen);
+        setLinks(slot, l, chosen);
+        for (int neighbor : chosen) addLink(neighbor, slot, l, arena);
+        entries = found;
     }
-    counter++; // Increment counter *after* visiting
 
-    //Traverse Right Subtree
-    return getNthRecordInorder(node->pRight, counter, targetIndex);
+    if (level > maxLevel) {
+        entryPoint = slot;
+        maxLevel = level;
+    }
 }
 
-VectorRecord* VectorStore::getVector(int index) {
-    if (index < 0 || index >= this->count) {
-        throw out_of_range("Index is invalid!");
+void HNSWIndex::markDeleted(int slot) {
+    if (slot < (int)levels.size() && levels[slot] != -1 && !deleted[slot]) {
+        deleted[slot] = 1;
+        deletedCount++;
     }
-    
-    int counter = 0;
-    // getRoot() is a public method of AVLTree
-    return getNthRecordInorder(this->vectorStore->getRoot(), counter, index);
 }
 
-string VectorStore::getRawText(int index) {
-    if (index < 0 || index >= this->count) {
-        throw out_of_range("Index is invalid!");
-    }
-    
-    int counter = 0;
-    VectorRecord* record = getNthRecordInorder(this->vectorStore->getRoot(), counter, index);
-    
-    return record->rawText;
+void HNSWIndex::clear() {
+    levels.clear();
+    deleted.clear();
+    level0.clear();
+    upper.clear();
+    visitTag.clear();
+    visitEpoch = 0;
+    entryPoint = -1;
+    maxLevel = -1;
+    nodeCount = 0;
+    deletedCount = 0;
 }
 
-int VectorStore::getId(int index) {
-    if (index < 0 || index >= this->count) {
-        throw out_of_range("Index is invalid!");
+vector<pair<double, int>> HNSWIndex::search(const float* query, int k, int ef, const float* arena, int& evaluated) {
+    vector<pair<double, int>> found;
+    evaluated = 0;
+    if (entryPoint == -1 || k <= 0) return found;
+    if (ef < k) ef = k;
+
+    int current = entryPoint;
+    for (int l = maxLevel; l > 0; --l) {
+        current = greedyClosest(query, current, l, arena, evaluated);
     }
-    
-    int counter = 0;
-    VectorRecord* record = getNthRecordInorder(this->vectorStore->getRoot(), counter, index);
-    
-    return record->id;
+    vector<pair<double, int>> entries(1, {distance(query, arena + (size_t)current * dimension), current});
+    searchLayer(query, entries, ef, 0, true, arena, found, evaluated);
+    if ((int)found.size() > k) found.resize(k);
+    return found;
 }
 
-bool VectorStore::removeAt(int index) {
-    if (index < 0 || index >= this->count) {
-        throw out_of_range("Index is invalid!");
+// =====================================
+// IVFIndex implementation
+// =====================================
+
+IVFIndex::IVFIndex(Metric metric, int dimension, int nlist) {
+    this->metric = metric;
+    this->dimension = dimension;
+    this->nlist = nlist;
+    this->cells = 0;
+    this->rngState = 0xD1B54A32D192ED03ULL; // fixed seed: same contents, same cells
+    this->members = 0;
+    this->trainedSize = 0;
+    this->updatesSinceTraining = 0;
+}
+
+double IVFIndex::distance(const float* a, const float* b) const {
+    return indexDistance(metric, a, b, dimension);
+}
+
+int IVFIndex::nearestCell(const float* row) const {
+    int best = 0;
+    double bestDistance = distance(row, &centroids[0]);
+    for (int c = 1; c < cells; ++c) {
+        double d = distance(row, &centroids[(size_t)c * dimension]);
+        if (d < bestDistance) {
+            bestDistance = d;
+            best = c;
+        }
     }
+    return best;
+}
 
-    int counter = 0;
-    VectorRecord* recordPtr = getNthRecordInorder(this->vectorStore->getRoot(), counter, index);
+// nearest[i] = closest cell of slots[i]; read-only, so split across threads
+void IVFIndex::assignParallel(const float* arena, const int* slots, int n, int* nearest, int threads) const {
+    if (n == 0) return;
+    long long work = (long long)n * cells; // distances to compute
+    int parts = partitionCount(work > (1 << 30) ? (1 << 30) : (int)work, threads);
+    if (parts > n) parts = n;
+    parallelFor(0, parts, parts, [&](int part) {
+        int begin = (int)((long long)n * part / parts);
+        int end = (int)((long long)n * (part + 1) / parts);
+        for (int i = begin; i < end; ++i) {
+            nearest[i] = nearestCell(arena + (size_t)slots[i] * dimension);
+        }
+    });
+}
 
-    VectorRecord recordToRemove = *recordPtr;
-    
-    double avlKey = recordToRemove.distanceFromReference;
-    double rbtKey = recordToRemove.norm;
-    int removedId = recordToRemove.id;
-    bool wasRoot = (this->rootVector != nullptr && removedId == this->rootVector->id);
+void IVFIndex::reserveSlot(int slot) {
+    if (slot < (int)cellOf.size()) return;
+    size_t newSize = cellOf.size() > 0 ? cellOf.size() * 2 : 16;
+    if (newSize <= (size_t)slot) newSize = slot + 1;
+    cellOf.resize(newSize, -1);
+    positionOf.resize(newSize, 0);
+}
 
-    // Free the vector's memory
-    delete recordToRemove.vector;
+// Mini-batch k-means (Sculley 2010): each round assigns a random batch of
+// records, then pulls every centroid toward its batch members with a
+// per-cell learning rate of 1 / (records absorbed so far)
+void IVFIndex::train(const float* arena, const vector<int>& slots, int threads) {
+    const int IVF_TRAINING_ROUNDS = 32;
+    int n = (int)slots.size();
+    cells = n < nlist ? n : nlist;
+    centroids.assign((size_t)cells * dimension, 0.0f);
+    postings.assign(cells, vector<int>());
+    for (int& cell : cellOf) cell = -1;
+    members = 0;
+    trainedSize = n;
+    updatesSinceTraining = 0;
+    if (cells == 0) return;
+
+    // Seed with distinct records: a partial Fisher-Yates shuffle
+    vector<int> order(slots);
+    for (int c = 0; c < cells; ++c) {
+        int pick = c + (int)(nextRandom(rngState) % (unsigned long long)(n - c));
+        int seed = order[pick];
+        order[pick] = order[c];
+        order[c] = seed;
+        const float* row = arena + (size_t)seed * dimension;
+        for (int i = 0; i < dimension; ++i) centroids[(size_t)c * dimension + i] = row[i];
+    }
 
-    // Remove from both trees
-    this->vectorStore->remove(avlKey);
-    this->normIndex->remove(rbtKey);
+    int batch = 8 * cells > 1024 ? 8 * cells : 1024;
+    if (batch > n) batch = n;
+    vector<int> sample(batch), nearest(batch);
+    vector<int> absorbed(cells, 0);
+    for (int round = 0; round < IVF_TRAINING_ROUNDS; ++round) {
+        for (int b = 0; b < batch; ++b) {
+            sample[b] = slots[nextRandom(rngState) % (unsigned long long)n];
+        }
+        assignParallel(arena, sample.data(), batch, nearest.data(), threads);
+        for (int b = 0; b < batch; ++b) {
+            float* centroid = &centroids[(size_t)nearest[b] * dimension];
+            const float* row = arena + (size_t)sample[b] * dimension;
+            float rate = 1.0f / ++absorbed[nearest[b]];
+            for (int i = 0; i < dimension; ++i) centroid[i] += rate * (row[i] - centroid[i]);
+        }
+    }
+}
 
-    // Update average distance
-    double oldTotalDistance = this->averageDistance * this->count;
-    double newTotalDistance = oldTotalDistance - recordToRemove.distanceFromReference;
-    
-    this->count--; // Decrement count
-    
-    if (this->count == 0) {
-        this->averageDistance = 0.0;
-    } 
-    else {
-        this->averageDistance = newTotalDistance / this->count;
+void IVFIndex::assign(const float* arena, const vector<int>& slots, int threads) {
+    for (vector<int>& list : postings) list.clear();
+    for (int& cell : cellOf) cell = -1;
+    members = 0;
+    if (cells == 0) return;
+
+    vector<int> nearest(slots.size());
+    assignParallel(arena, slots.data(), (int)slots.size(), nearest.data(), threads);
+    // Lists are filled in the given (slot) order, so the result does not depend on threads
+    for (size_t i = 0; i < slots.size(); ++i) {
+        reserveSlot(slots[i]);
+        cellOf[slots[i]] = nearest[i];
+        positionOf[slots[i]] = (int)postings[nearest[i]].size();
+        postings[nearest[i]].push_back(slots[i]);
+        members++;
     }
+}
 
-    // Handle root vector replacement
-    if (this->count == 0) { //store is empty
-        delete this->rootVector;
-        this->rootVector = nullptr;
-    } 
-    else if (wasRoot) {
-        // find newRoot
-        
-        queue<AVLTree<double, VectorRecord>::AVLNode*> q;
-        q.push(this->vectorStore->getRoot());
+void IVFIndex::setCentroid(int cell, const float* values) {
+    for (int i = 0; i < dimension; ++i) centroids[(size_t)cell * dimension + i] = values[i];
+}
 
-        VectorRecord* newRoot = nullptr;
-        double minDiff = -1.0; // Use -1.0 = not set
+void IVFIndex::insert(int slot, const float* arena) {
+    updatesSinceTraining++;
+    if (cells == 0) return; // picked up by the first training
+    reserveSlot(slot);
+    int cell = nearestCell(arena + (size_t)slot * dimension);
+    cellOf[slot] = cell;
+    positionOf[slot] = (int)postings[cell].size();
+    postings[cell].push_back(slot);
+    members++;
+}
 
-        while (!q.empty()) {
-            AVLTree<double, VectorRecord>::AVLNode* node = q.front();
-            q.pop();
-            
-            if (node == nullptr) continue;
+void IVFIndex::remove(int slot) {
+    updatesSinceTraining++;
+    if (slot >= (int)cellOf.size() || cellOf[slot] == -1) return;
+    vector<int>& list = postings[cellOf[slot]];
+    int position = positionOf[slot];
+    int last = list.back();
+    list[position] = last;
+    positionOf[last] = position;
+    list.pop_back();
+    cellOf[slot] = -1;
+    members--;
+}
 
-            // Get pointer to the record *inside* the node
-            VectorRecord* currentRecord = &(node->data);
-            double diff = fabs(currentRecord->distanceFromReference - this->averageDistance);
+void IVFIndex::clear() {
+    cells = 0;
+    centroids.clear();
+    postings.clear();
+    cellOf.clear();
+    positionOf.clear();
+    members = 0;
+    trainedSize = 0;
+    updatesSinceTraining = 0;
+}
 
-            if (newRoot == nullptr || diff < minDiff) {
-                minDiff = diff;
-                newRoot = currentRecord;
-            }
+bool IVFIndex::needsRetraining(int storeSize) const {
+    const int IVF_IMBALANCE_LIMIT = 4; // largest cell vs the average cell
+    if (storeSize == 0) return false;
+    if (cells == 0) return true;
+    // A retraining costs about as much as the updates since the last one
+    if (2 * updatesSinceTraining < trainedSize) return false;
+    if (cells < nlist && storeSize > trainedSize) return true;
+    size_t largest = 0;
+    for (const vector<int>& list : postings) {
+        if (list.size() > largest) largest = list.size();
+    }
+    return (long long)largest * cells > (long long)IVF_IMBALANCE_LIMIT * members;
+}
 
-            if (node->pLeft) q.push(node->pLeft);
-            if (node->pRight) q.push(node->pRight);
+void IVFIndex::probe(const float* query, int nprobe, vector<int>& candidates, int& evaluated) const {
+    evaluated = 0;
+    if (cells == 0) return;
+    if (nprobe > cells) nprobe = cells;
+
+    // The nprobe closest centroids, kept sorted by insertion
+    vector<pair<double, int>> closest;
+    closest.reserve(nprobe + 1);
+    for (int c = 0; c < cells; ++c) {
+        double d = distance(query, &centroids[(size_t)c * dimension]);
+        evaluated++;
+        if ((int)closest.size() == nprobe && d >= closest.back().first) continue;
+        if ((int)closest.size() == nprobe) closest.pop_back();
+        closest.push_back({d, c});
+        for (size_t j = closest.size() - 1; j > 0 && closest[j].first < closest[j - 1].first; --j) {
+            pair<double, int> item = closest[j];
+            closest[j] = closest[j - 1];
+            closest[j - 1] = item;
         }
-        
-        // Delete the old rootVector
-        delete this->rootVector;
-        // Make a new copy of the new root
-        this->rootVector = new VectorRecord(*newRoot);
-        // Rebuild AVL so that the selected rootVector becomes the actual AVL root
-        rebuildTreeWithNewRoot(this->rootVector);
     }
+    for (const pair<double, int>& cell : closest) {
+        const vector<int>& list = postings[cell.second];
+        candidates.insert(candidates.end(), list.begin(), list.end());
+    }
+}
 
-    return true;
+// =====================================
+// ProductQuantizer implementation
+// =====================================
+
+// Records sampled to train the codebooks: about 40 per codeword
+static const int PQ_TRAINING_SAMPLE = 256 * 40;
+
+ProductQuantizer::ProductQuantizer(int dimension, int subspaces) {
+    this->dimension = dimension;
+    this->subspaces = subspaces;
+    this->codewords = 0;
+    this->trainedSize = 0;
+    // Widths differ by at most one when subspaces does not divide dimension
+    this->subStart.resize(subspaces + 1);
+    for (int s = 0; s <= subspaces; ++s) {
+        this->subStart[s] = (int)((long long)dimension * s / subspaces);
+    }
 }
 
+// Index of the codeword (count rows of width floats) closest to sub. Sub-vectors
+// are a few floats wide, so the loop is inline rather than a kernel call.
+static int nearestCodeword(const float* sub, const float* book, int count, int width) {
+    int best = 0;
+    float bestDistance = 0.0f;
+    for (int c = 0; c < count; ++c) {
+        const float* word = book + (size_t)c * width;
+        float d = 0.0f;
+        for (int i = 0; i < width; ++i) {
+            float diff = sub[i] - word[i];
+            d += diff * diff;
+        }
+        if (c == 0 || d < bestDistance) {
+            bestDistance = d;
+            best = c;
+        }
+    }
+    return best;
+}
 
-// REFERENCE VECTOR AND EMBEDDING FUNCTION MANAGEMENT
-void VectorStore::setReferenceVector(const vector<float>& newReference) {
+void ProductQuantizer::reserveSlot(int slot) {
+    size_t rows = codes.size() / subspaces;
+    if ((size_t)slot < rows) return;
+    size_t newRows = rows > 0 ? rows * 2 : 16;
+    if (newRows <= (size_t)slot) newRows = slot + 1;
+    codes.resize(newRows * subspaces, 0);
+}
 
-    delete this->referenceVector;
-    this->referenceVector = new vector<float>(newReference);
+void ProductQuantizer::encodeRow(const float* row, unsigned char* code) const {
+    for (int s = 0; s < subspaces; ++s) {
+        int width = subStart[s + 1] - subStart[s];
+        const float* book = &codebooks[(size_t)codewords * subStart[s]];
+        code[s] = (unsigned char)nearestCodeword(row + subStart[s], book, codewords, width);
+    }
+}
 
-    // If the store is empty -> done
-    if (this->count == 0) {
-        return;
+void ProductQuantizer::train(const float* arena, const vector<int>& slots, int threads) {
+    const int PQ_TRAINING_ROUNDS = 10;
+    int n = (int)slots.size();
+    codewords = n < 256 ? n : 256;
+    trainedSize = n;
+    codebooks.assign((size_t)codewords * dimension, 0.0f);
+    if (codewords == 0) return;
+
+    // Fixed-seed sample without replacement: a partial Fisher-Yates shuffle
+    unsigned long long rngState = 0x94D049BB133111EBULL;
+    int m = n < PQ_TRAINING_SAMPLE ? n : PQ_TRAINING_SAMPLE;
+    vector<int> sample(slots);
+    for (int i = 0; i < m; ++i) {
+        int pick = i + (int)(nextRandom(rngState) % (unsigned long long)(n - i));
+        int chosen = sample[pick];
+        sample[pick] = sample[i];
+        sample[i] = chosen;
     }
+    sample.resize(m);
+
+    // Lloyd's k-means in every subspace, seeded with the first sampled rows.
+    // The subspaces are independent, so they are trained on separate threads.
+    parallelFor(0, subspaces, threads, [&](int s) {
+        int offset = subStart[s];
+        int width = subStart[s + 1] - offset;
+        float* book = &codebooks[(size_t)codewords * offset];
+        for (int c = 0; c < codewords; ++c) {
+            const float* row = arena + (size_t)sample[c] * dimension + offset;
+            for (int i = 0; i < width; ++i) book[(size_t)c * width + i] = row[i];
+        }
 
-    // re-calculate all distances and rebuild the AVL tree.
-    vector<VectorRecord> allRecords;
-    allRecords.reserve(this->count); // Reserve space
+        vector<double> sums((size_t)codewords * width);
+        vector<int> counts(codewords);
+        for (int round = 0; round < PQ_TRAINING_ROUNDS; ++round) {
+            sums.assign(sums.size(), 0.0);
+            counts.assign(codewords, 0);
+            for (int i = 0; i < m; ++i) {
+                const float* sub = arena + (size_t)sample[i] * dimension + offset;
+                int c = nearestCodeword(sub, book, codewords, width);
+                counts[c]++;
+                for (int j = 0; j < width; ++j) sums[(size_t)c * width + j] += sub[j];
+            }
+            for (int c = 0; c < codewords; ++c) {
+                if (counts[c] == 0) continue; // empty cluster: keep the old codeword
+                for (int j = 0; j < width; ++j) book[(size_t)c * width + j] = (float)(sums[(size_t)c * width + j] / counts[c]);
+            }
+        }
+    });
+
+    // Re-encode every row with the new codebooks
+    for (int slot : slots) reserveSlot(slot);
+    int parts = partitionCount(n, threads);
+    parallelFor(0, parts, parts, [&](int part) {
+        int begin = (int)((long long)n * part / parts);
+        int end = (int)((long long)n * (part + 1) / parts);
+        for (int i = begin; i < end; ++i) {
+            encodeRow(arena + (size_t)slots[i] * dimension, &codes[(size_t)slots[i] * subspaces]);
+        }
+    });
+}
 
-    // use AVL to traverse (BFS) to collect all current records
-    queue<AVLTree<double, VectorRecord>::AVLNode*> q;
-    q.push(this->vectorStore->getRoot()); // Use public getRoot()
+void ProductQuantizer::encode(int slot, const float* row) {
+    if (codewords == 0) return; // picked up by the first training
+    reserveSlot(slot);
+    encodeRow(row, &codes[(size_t)slot * subspaces]);
+}
 
-    while (!q.empty()) {
-        AVLTree<double, VectorRecord>::AVLNode* node = q.front();
-        q.pop();
+void ProductQuantizer::clear() {
+    codewords = 0;
+    codebooks.clear();
+    codes.clear();
+    trainedSize = 0;
+}
 
-        if (node == nullptr) continue;
-        
-        // Store a *copy* of the record. 
-        // Note: The vector<float>* pointer is copied, so the data it points to 
-        // remains valid even after we clear the tree nodes below.
-        allRecords.push_back(node->data);
+bool ProductQuantizer::needsRetraining(int storeSize) const {
+    if (storeSize == 0) return false;
+    if (codewords == 0) return true;
+    // Once the sample is full the codebooks stay; before that, retrain (and
+    // re-encode) each time the store doubles: O(256 * d) amortized per insert
+    return trainedSize < PQ_TRAINING_SAMPLE && storeSize >= 2 * trainedSize;
+}
 
-        if (node->pLeft) q.push(node->pLeft);
-        if (node->pRight) q.push(node->pRight);
+void ProductQuantizer::buildTable(const float* query, Metric metric, vector<float>& table) const {
+    table.assign((size_t)subspaces * 256, 0.0f);
+    for (int s = 0; s < subspaces; ++s) {
+        int width = subStart[s + 1] - subStart[s];
+        const float* sub = query + subStart[s];
+        const float* book = &codebooks[(size_t)codewords * subStart[s]];
+        for (int c = 0; c < codewords; ++c) {
+            const float* word = book + (size_t)c * width;
+            double term = 0.0;
+            switch (metric) {
+                case EUCLIDEAN: term = l2Kernel(sub, word, width); term *= term; break;
+                case MANHATTAN: term = l1Kernel(sub, word, width); break;
+                case COSINE:    term = dotKernel(sub, word, width); break;
+            }
+            table[s * 256 + c] = (float)term;
+        }
     }
+}
 
-    // clear both trees (deletes nodes, but not the float vectors pointed to by records)
-    this->vectorStore->clear();
-    this->normIndex->clear();
+// =====================================
+// ScalarQuantizer implementation
+// =====================================
 
-    // Re-compute distances and update average
-    double totalDistance = 0.0;
-    for (VectorRecord& rec : allRecords) {
-        rec.distanceFromReference = l2Distance(*rec.vector, *this->referenceVector);
-        totalDistance += rec.distanceFromReference;
-    }
+ScalarQuantizer::ScalarQuantizer(int dimension) {
+    this->dimension = dimension;
+    this->isTrained = false;
+    this->trainedSize = 0;
+    this->clampedSinceTraining = 0;
+}
 
-    this->averageDistance = totalDistance / this->count;
+void ScalarQuantizer::reserveSlot(int slot) {
+    size_t rows = dimension > 0 ? codes.size() / dimension : 0;
+    if ((size_t)slot < rows) return;
+    size_t newRows = rows > 0 ? rows * 2 : 16;
+    if (newRows <= (size_t)slot) newRows = slot + 1;
+    codes.resize(newRows * dimension, 0);
+    rowTerms.resize(newRows, 0.0f);
+}
 
-    // Find the new root vector (closest to average distance)
-    VectorRecord* newRoot = nullptr;
-    double minDiff = -1.0; // -1 = not set
+bool ScalarQuantizer::encodeRow(const float* row, unsigned char* code, float& rowTerm) const {
+    bool inRange = true;
+    double term = 0.0;
+    for (int i = 0; i < dimension; ++i) {
+        float level = scale[i] > 0.0f ? (row[i] - offset[i]) / scale[i] : 0.0f;
+        if (level < 0.0f || level > 255.0f) inRange = false;
+        level = level < 0.0f ? 0.0f : (level > 255.0f ? 255.0f : level);
+        code[i] = (unsigned char)(level + 0.5f);
+        double value = (double)scale[i] * code[i];
+        term += value * value;
+    }
+    rowTerm = (float)term;
+    return inRange;
+}
 
-    for (VectorRecord& rec : allRecords) {
-        double diff = fabs(rec.distanceFromReference - this->averageDistance);
-        
-        if (newRoot == nullptr || diff < minDiff) {
-            minDiff = diff;
-            newRoot = &rec; // Point to the record in our vector
+void ScalarQuantizer::train(const float* arena, const vector<int>& slots, int threads) {
+    int n = (int)slots.size();
+    isTrained = n > 0;
+    trainedSize = n;
+    clampedSinceTraining = 0;
+    if (n == 0) return;
+
+    // Per-dimension range over every row: O(n * d)
+    vector<float> low(arena + (size_t)slots[0] * dimension, arena + (size_t)slots[0] * dimension + dimension);
+    vector<float> high(low);
+    for (int slot : slots) {
+        const float* row = arena + (size_t)slot * dimension;
+        for (int i = 0; i < dimension; ++i) {
+            if (row[i] < low[i]) low[i] = row[i];
+            if (row[i] > high[i]) high[i] = row[i];
         }
     }
+    offset = low;
+    scale.resize(dimension);
+    kernelScale.resize(dimension);
+    for (int i = 0; i < dimension; ++i) {
+        scale[i] = (high[i] - low[i]) / 255.0f;
+        kernelScale[codeOrder(i, dimension)] = scale[i];
+    }
 
-    // Update new rootVector property
-    delete this->rootVector;
-    this->rootVector = new VectorRecord(*newRoot);
+    for (int slot : slots) reserveSlot(slot);
+    int parts = partitionCount(n, threads);
+    parallelFor(0, parts, parts, [&](int part) {
+        int begin = (int)((long long)n * part / parts);
+        int end = (int)((long long)n * (part + 1) / parts);
+        for (int i = begin; i < end; ++i) {
+            encodeRow(arena + (size_t)slots[i] * dimension, &codes[(size_t)slots[i] * dimension], rowTerms[slots[i]]);
+        }
+    });
+}
 
-    // Re-insert all records into the trees
-    for (const VectorRecord& rec : allRecords) {
-        // 1. Insert into AVL tree with new distance
-        this->vectorStore->insert(rec.distanceFromReference, rec);
-        
-        // 2. Re-insert into RBT 
-        this->normIndex->insert(rec.norm, rec);
+void ScalarQuantizer::encode(int slot, const float* row) {
+    if (!isTrained) return; // picked up by the first training
+    reserveSlot(slot);
+    if (!encodeRow(row, &codes[(size_t)slot * dimension], rowTerms[slot])) {
+        clampedSinceTraining++;
     }
+}
 
-    rebuildTreeWithNewRoot(this->rootVector);
+void ScalarQuantizer::clear() {
+    isTrained = false;
+    offset.clear();
+    scale.clear();
+    kernelScale.clear();
+    codes.clear();
+    rowTerms.clear();
+    trainedSize = 0;
+    clampedSinceTraining = 0;
 }
 
-vector<float>* VectorStore::getReferenceVector() const {
-    return this->referenceVector;
+bool ScalarQuantizer::needsRetraining(int storeSize) const {
+    if (storeSize == 0) return false;
+    if (!isTrained) return true;
+    // Retraining is one O(n * d) pass, so it is amortized O(d) per insert
+    return storeSize >= 2 * trainedSize || 8 * clampedSinceTraining > trainedSize;
 }
-VectorRecord* VectorStore::getRootVector() const {
-    return this->rootVector;
+
+void ScalarQuantizer::prepareQuery(const float* query, Metric metric, vector<float>& operand, double& bias) const {
+    operand.resize(dimension);
+    bias = 0.0;
+    for (int i = 0; i < dimension; ++i) {
+        int j = codeOrder(i, dimension);
+        if (metric == COSINE) {
+            operand[j] = query[i] * scale[i];
+            bias += (double)query[i] * offset[i];
+        } else if (metric == EUCLIDEAN) {
+            float u = query[i] - offset[i];
+            operand[j] = u * scale[i];
+            bias += (double)u * u;
+        } else {
+            operand[j] = query[i] - offset[i];
+        }
+    }
+}
+
+// =====================================
+// SimHasher implementation
+// =====================================
+
+SimHasher::SimHasher(int dimension, int bits) {
+    this->dimension = dimension;
+    this->bits = bits;
+    // Gaussian directions (Box-Muller) from a fixed seed: same store, same signatures
+    unsigned long long rngState = 0x94D049BB133111EBULL;
+    this->directions.resize((size_t)bits * dimension);
+    for (size_t i = 0; i < this->directions.size(); i += 2) {
+        double u1 = ((nextRandom(rngState) >> 11) + 1.0) / 9007199254740993.0; // (0, 1]
+        double u2 = (nextRandom(rngState) >> 11) / 9007199254740992.0;         // [0, 1)
+        double radius = sqrt(-2.0 * log(u1));
+        double angle = 6.283185307179586 * u2;
+        this->directions[i] = (float)(radius * cos(angle));
+        if (i + 1 < this->directions.size()) this->directions[i + 1] = (float)(radius * sin(angle));
+    }
+}
+
+void SimHasher::reserveSlot(int slot) {
+    size_t rows = signatures.size() / words();
+    if ((size_t)slot < rows) return;
+    size_t newRows = rows > 0 ? rows * 2 : 16;
+    if (newRows <= (size_t)slot) newRows = slot + 1;
+    signatures.resize(newRows * words(), 0);
+}
+
+void SimHasher::sign(const float* row, unsigned long long* signature) const {
+    for (int w = 0; w < words(); ++w) signature[w] = 0;
+    for (int b = 0; b < bits; ++b) {
+        if (dotKernel(&directions[(size_t)b * dimension], row, dimension) > 0.0) {
+            signature[b / 64] |= 1ULL << (b % 64);
+        }
+    }
+}
+
+void SimHasher::encode(int slot, const float* arena) {
+    reserveSlot(slot);
+    sign(arena + (size_t)slot * dimension, &signatures[(size_t)slot * words()]);
+}
+
+void SimHasher::clear() {
+    signatures.clear();
+}
+
+// =====================================
+// KDTree implementation
+// =====================================
+
+KDTree::KDTree(int dimension, int leafSize) {
+    this->dimension = dimension;
+    this->leafSize = leafSize;
+    this->members = 0;
+    newLeaf(); // root
+}
+
+int KDTree::newLeaf() {
+    Node leaf;
+    leaf.splitDim = -1;
+    leaf.splitValue = 0.0f;
+    leaf.left = leaf.right = -1;
+    leaf.capacity = leafSize;
+    nodes.push_back(leaf);
+    return (int)nodes.size() - 1;
+}
+
+// Splits a full leaf at the midpoint of its widest dimension, recursing into
+// children that are still too full. A leaf of identical rows stays whole and
+// doubles its capacity, so the scan is not repeated on every insert.
+void KDTree::splitLeaf(int leaf, const float* arena) {
+    const vector<int>& bucket = nodes[leaf].bucket;
+    int widest = -1;
+    float low = 0.0f, high = 0.0f, spread = 0.0f;
+    for (int i = 0; i < dimension; ++i) {
+        float lo = arena[(size_t)bucket[0] * dimension + i], hi = lo;
+        for (size_t j = 1; j < bucket.size(); ++j) {
+            float value = arena[(size_t)bucket[j] * dimension + i];
+            if (value < lo) lo = value;
+            if (value > hi) hi = value;
+        }
+        if (hi - lo > spread) { widest = i; low = lo; high = hi; spread = hi - lo; }
+    }
+    if (widest == -1) {
+        nodes[leaf].capacity = 2 * (int)bucket.size();
+        return;
+    }
+
+    float split = low + (high - low) * 0.5f;
+    if (split <= low) split = high; // adjacent floats: the low rows still go left
+    int left = newLeaf(), right = newLeaf(); // may move nodes: no references held across
+    vector<int> slots;
+    slots.swap(nodes[leaf].bucket);
+    nodes[leaf].splitDim = widest;
+    nodes[leaf].splitValue = split;
+    nodes[leaf].left = left;
+    nodes[leaf].right = right;
+    for (int slot : slots) {
+        int child = arena[(size_t)slot * dimension + widest] < split ? left : right;
+        nodes[child].bucket.push_back(slot);
+        leafOf[slot] = child;
+    }
+    if ((int)nodes[left].bucket.size() > nodes[left].capacity) splitLeaf(left, arena);
+    if ((int)nodes[right].bucket.size() > nodes[right].capacity) splitLeaf(right, arena);
+}
+
+void KDTree::build(const float* arena, const vector<int>& slots) {
+    clear();
+    for (int slot : slots) {
+        if ((int)leafOf.size() <= slot) leafOf.resize(slot + 1, -1);
+        leafOf[slot] = 0;
+    }
+    nodes[0].bucket = slots;
+    members = (int)slots.size();
+    if (members > nodes[0].capacity) splitLeaf(0, arena);
+}
+
+void KDTree::insert(int slot, const float* arena) {
+    const float* row = arena + (size_t)slot * dimension;
+    int node = 0;
+    while (nodes[node].splitDim != -1) {
+        node = row[nodes[node].splitDim] < nodes[node].splitValue ? nodes[node].left : nodes[node].right;
+    }
+    if ((int)leafOf.size() <= slot) {
+        size_t newSize = leafOf.size() > 0 ? leafOf.size() * 2 : 16;
+        if (newSize <= (size_t)slot) newSize = slot + 1;
+        leafOf.resize(newSize, -1);
+    }
+    nodes[node].bucket.push_back(slot);
+    leafOf[slot] = node;
+    members++;
+    if ((int)nodes[node].bucket.size() > nodes[node].capacity) splitLeaf(node, arena);
+}
+
+void KDTree::remove(int slot) {
+    if (slot >= (int)leafOf.size() || leafOf[slot] == -1) return;
+    vector<int>& bucket = nodes[leafOf[slot]].bucket;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i] == slot) {
+            bucket[i] = bucket.back();
+            bucket.pop_back();
+            break;
+        }
+    }
+    leafOf[slot] = -1;
+    members--;
+}
+
+void KDTree::clear() {
+    nodes.clear();
+    leafOf.clear();
+    members = 0;
+    newLeaf();
+}
+
+void KDTree::query(const float* arena, const float* minBound, const float* maxBound,
+                   vector<int>& matches, int& evaluated) const {
+    vector<int> pending(1, 0);
+    while (!pending.empty()) {
+        const Node& node = nodes[pending.back()];
+        pending.pop_back();
+        if (node.splitDim != -1) {
+            // Left rows are < split, right rows >= split; a row must also be
+            // strictly inside (minBound, maxBound) on that dimension
+            if (maxBound[node.splitDim] > node.splitValue) pending.push_back(node.right);
+            if (minBound[node.splitDim] < node.splitValue) pending.push_back(node.left);
+            continue;
+        }
+        for (int slot : node.bucket) {
+            const float* row = arena + (size_t)slot * dimension;
+            evaluated++;
+            bool inside = true;
+            for (int i = 0; i < dimension && inside; ++i) {
+                inside = row[i] > minBound[i] && row[i] < maxBound[i];
+            }
+            if (inside) matches.push_back(slot);
+        }
+    }
+}
+
+// Bottom-up merge sort of (key, slot) handles by key. Stable and O(n log n);
+// written out here because the single-include rule keeps <algorithm> out.
+static void sortHandles(vector<IndexKey>& keys, vector<int>& slots) {
+    int n = (int)keys.size();
+    vector<IndexKey> keyBuffer(keys);
+    vector<int> slotBuffer(slots);
+    for (int width = 1; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = min(lo + width, n), hi = min(lo + 2 * width, n);
+            int i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                if (keys[j] < keys[i]) { keyBuffer[k] = keys[j]; slotBuffer[k++] = slots[j++]; }
+                else                   { keyBuffer[k] = keys[i]; slotBuffer[k++] = slots[i++]; }
+            }
+            while (i < mid) { keyBuffer[k] = keys[i]; slotBuffer[k++] = slots[i++]; }
+            while (j < hi)  { keyBuffer[k] = keys[j]; slotBuffer[k++] = slots[j++]; }
+        }
+        keys.swap(keyBuffer);
+        slots.swap(slotBuffer);
+    }
+}
+
+// Merges two sorted handle lists into out (which is overwritten)
+static void mergeHandles(const vector<IndexKey>& aKeys, const vector<int>& aSlots,
+                         const vector<IndexKey>& bKeys, const vector<int>& bSlots,
+                         vector<IndexKey>& outKeys, vector<int>& outSlots) {
+    outKeys.clear();
+    outSlots.clear();
+    outKeys.reserve(aKeys.size() + bKeys.size());
+    outSlots.reserve(aKeys.size() + bKeys.size());
+    size_t i = 0, j = 0;
+    while (i < aKeys.size() || j < bKeys.size()) {
+        if (j == bKeys.size() || (i < aKeys.size() && aKeys[i] < bKeys[j])) {
+            outKeys.push_back(aKeys[i]);
+            outSlots.push_back(aSlots[i++]);
+        } else {
+            outKeys.push_back(bKeys[j]);
+            outSlots.push_back(bSlots[j++]);
+        }
+    }
+}
+
+// =====================================
+// VectorStore implementation
+// =====================================
+
+//TODO: Implement all VectorStore methods here
+
+//CONSTRUCTOR
+VectorStore::VectorStore( int dimension, 
+    vector<float>* (*embeddingFunction)(const string&),
+    const vector<float>& referenceVector){
+    
+    this->dimension = dimension;
+    this->embeddingFunction = embeddingFunction;
+    this->workerThreads = 0;
+    this->lastDistanceEvaluations = 0;
+    this->pivotTarget = 0;
+    this->pivotsChosen = 0;
+    this->pivotSelectionCount = 0;
+    this->ingestWindow = 1024;
+    this->hnsw = nullptr;
+    this->hnswEfSearch = 64;
+    this->ivf = nullptr;
+    this->ivfProbes = 8;
+    this->pq = nullptr;
+    this->int8Codes = nullptr;
+    this->rerankDepth = 0;
+    this->rowsDropped = false;
+    this->simHash = nullptr;
+    this->simHashCandidates = 256;
+    this->kdTree = nullptr;
+    this->precision = FP32;
+    this->count = 0;
+    this->averageDistance = 0.0;
+
+    // Allocate the trees (empty); both index slots of the record table
+    this->vectorStore = new AVLTree<IndexKey, int>();        //avl
+    this->normIndex   = new RedBlackTree<IndexKey, int>();   //rbt
+    this->idIndex     = new IdIndex();                     //id -> slot
+    this->nextId      = 0;
+
+    // Copy reference vector, padded or truncated to `dimension` like an
+    // embedding: the distance kernels read exactly that many floats
+    this->referenceVector = new vector<float>(referenceVector);
+    this->referenceVector->resize(this->dimension, 0.0f);
+
+    // No root vector yet
+    this->rootSlot = -1;            //slot of the root vector of avl
+
+    // Arena and record table are allocated lazily on the first insert
+    this->records = nullptr;
+    this->arena = nullptr;
+    this->arenaCapacity = 0;
+    this->arenaSize = 0;
+}
+// DESRUCTOR
+VectorStore::~VectorStore()
+{
+    // Clear all AVL and Red-Black tree contents
+    if (vectorStore) {
+        vectorStore->clear();
+        delete vectorStore;
+        vectorStore = nullptr;
+    }
+
+    if (normIndex) {
+        normIndex->clear();
+        delete normIndex;
+        normIndex = nullptr;
+    }
+
+    delete idIndex;
+    idIndex = nullptr;
+
+    delete hnsw;
+    hnsw = nullptr;
+    delete ivf;
+    ivf = nullptr;
+    delete pq;
+    pq = nullptr;
+    delete int8Codes;
+    int8Codes = nullptr;
+    delete simHash;
+    simHash = nullptr;
+    delete kdTree;
+    kdTree = nullptr;
+
+    // Delete referenceVector
+    if (referenceVector) {
+        delete referenceVector;
+        referenceVector = nullptr;
+    }
+
+    // Release the record table and the embedding arena
+    delete[] records;
+    records = nullptr;
+    if (arena) {
+        ::operator delete(arena, std::align_val_t(ARENA_ALIGNMENT));
+        arena = nullptr;
+    }
+}
+
+//SIZE
+int VectorStore::size() {
+    return this->count;
+}
+
+//EMPTY
+bool VectorStore::empty(){
+    return this->count == 0;
+}
+
+//CLEAR
+void VectorStore::clear(){
+    if(vectorStore) vectorStore->clear(); // clear avl
+    if(normIndex)   normIndex->clear(); // clear RBT
+    this->idIndex->clear();
+    this->nextId = 0;
+    this->count = 0;
+    this->averageDistance = 0.0;
+    this->rootSlot = -1;
+
+    // Keep the arena allocation, just forget every row and record
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        this->records[slot] = VectorRecord();
+    }
+    this->arenaSize = 0;
+    this->freeSlots.clear();
+
+    // Keep the pivot setting; pivots are picked again from the new contents
+    this->pivotVectors.clear();
+    this->pivotsChosen = 0;
+    this->pivotSelectionCount = 0;
+
+    // Keep HNSW on (same metric and parameters) with an empty graph
+    if (this->hnsw) this->hnsw->clear();
+    this->hnswPendingSlots.clear();
+    if (this->ivf) this->ivf->clear();
+    if (this->pq) this->pq->clear();
+    if (this->int8Codes) this->int8Codes->clear();
+    if (this->simHash) this->simHash->clear();
+    if (this->kdTree) this->kdTree->clear();
+
+    // The training went with the codes: an empty store takes its float rows back
+    if (this->rowsDropped) {
+        size_t bytes = (size_t)this->arenaCapacity * this->dimension * sizeof(float);
+        if (bytes == 0) bytes = ARENA_ALIGNMENT;
+        this->arena = static_cast<float*>(::operator new(bytes, std::align_val_t(ARENA_ALIGNMENT)));
+        this->rowsDropped = false;
+        vector<float>().swap(this->stagingRow);
+    }
+}
+
+// ARENA STORAGE
+void VectorStore::growArena(int minRows) {
+    int newCapacity = this->arenaCapacity > 0 ? this->arenaCapacity * 2 : 16;
+    if (newCapacity < minRows) newCapacity = minRows;
+
+    // Without float rows only the record table grows
+    if (!this->rowsDropped) {
+        size_t bytes = (size_t)newCapacity * this->dimension * sizeof(float);
+        if (bytes == 0) bytes = ARENA_ALIGNMENT; // dimension 0: keep a valid block
+        float* newArena = static_cast<float*>(::operator new(bytes, std::align_val_t(ARENA_ALIGNMENT)));
+
+        if (this->arena) {
+            std::copy(this->arena, this->arena + (size_t)this->arenaSize * this->dimension, newArena);
+            ::operator delete(this->arena, std::align_val_t(ARENA_ALIGNMENT));
+        }
+        this->arena = newArena;
+    }
+    this->arenaCapacity = newCapacity;
+
+    if (this->precision != FP32) {
+        this->packedRows.resize((size_t)newCapacity * this->dimension);
+    }
+
+    // The record table grows with the arena; rows moved, so refresh every view
+    VectorRecord* newRecords = new VectorRecord[newCapacity];
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        newRecords[slot] = std::move(this->records[slot]);
+        if (newRecords[slot].id != -1 && !this->rowsDropped) {
+            newRecords[slot].vector = RowPointer(rowAt(slot), this->dimension);
+            if (this->precision != FP32) {
+                newRecords[slot].packed = this->packedRows.data() + (size_t)slot * this->dimension;
+            }
+        }
+    }
+    delete[] this->records;
+    this->records = newRecords;
+
+    // The pivot table has one row per slot as well
+    this->pivotTable.resize((size_t)newCapacity * this->pivotTarget);
+}
+
+// Writes the 16-bit copy of row `slot` and points its record at it (no-op at FP32)
+void VectorStore::packRow(int slot) {
+    if (this->precision == FP32) return;
+    const float* row = rowAt(slot);
+    unsigned short* packed = this->packedRows.data() + (size_t)slot * this->dimension;
+    for (int i = 0; i < this->dimension; ++i) {
+        packed[i] = packValue(row[i], this->precision);
+    }
+    this->records[slot].packed = packed;
+}
+
+int VectorStore::allocateSlot() {
+    // Reuse a slot freed by removeAt before extending the arena
+    if (!this->freeSlots.empty()) {
+        int slot = this->freeSlots.back();
+        this->freeSlots.pop_back();
+        return slot;
+    }
+    if (this->arenaSize == this->arenaCapacity) {
+        growArena(this->arenaSize + 1);
+    }
+    return this->arenaSize++;
+}
+
+void VectorStore::releaseSlot(int slot) {
+    this->records[slot] = VectorRecord(); // id -1 marks the slot as free
+    // The HNSW graph still routes through the row: hold it until the next rebuild
+    if (this->hnsw) this->hnswPendingSlots.push_back(slot);
+    else this->freeSlots.push_back(slot);
+}
+
+// PREPROCESSING AND DATA MANAGEMENT
+
+vector<float>* VectorStore::preprocessing(string rawText) {
+    // Call embeddingFunction to map the text to a vector
+    vector<float>* vec = embeddingFunction(rawText);
+    if (!vec) return nullptr;
+
+    // if size > dimension -> truncate trailing
+    if (vec->size() > static_cast<size_t>(dimension)) {
+        vec->resize(dimension);
+    }
+
+    // if size < dimension -> pad with 0's
+    else if (vec->size() < static_cast<size_t>(dimension)) {
+        vec->insert(vec->end(), dimension - vec->size(), 0.0f);
+    }
+
+    // Below FP32, round once here: the stored float row and its 16-bit copy then agree
+    if (this->precision != FP32) {
+        for (float& val : *vec) val = roundToPrecision(val, this->precision);
+    }
+
+    // Return the normalized vector
+    return vec;
+}
+
+void VectorStore::addText(string rawText) {
+    
+    // use preprocessing to convert text into a vector.
+    vector<float>* newVec = this->preprocessing(rawText);
+    if (newVec == nullptr) {
+        return; 
+    }
+
+    int slot = storeRecord(rawText, newVec);
+    admitRecord(slot);
+    const float* row = this->rowsDropped ? this->stagingRow.data() : rowAt(slot);
+
+    // insert the slot into AVL and RBT: O(log n) each.
+    // Keys carry the id, so equal distances or norms never collide.
+    const VectorRecord& newRecord = this->records[slot];
+    this->vectorStore->insert(IndexKey(newRecord.distanceFromReference, newRecord.id), slot);
+    this->normIndex->insert(IndexKey(newRecord.norm, newRecord.id), slot);
+    if (this->hnsw) this->hnsw->insert(slot, this->arena);
+    if (this->ivf) this->ivf->insert(slot, this->arena);
+    if (this->pq) this->pq->encode(slot, row);
+    if (this->int8Codes) this->int8Codes->encode(slot, row);
+    if (this->simHash) this->simHash->encode(slot, this->arena);
+    if (this->kdTree) this->kdTree->insert(slot, this->arena);
+    rebuildRootIfNeeded();
+    retrainIndexesIfNeeded();
+    updatePivots();
+}
+
+// Moves an embedding into a fresh arena row and fills in its record and id.
+// Takes ownership of vec. The trees and the running statistics are not touched.
+int VectorStore::storeRecord(const string& rawText, vector<float>* vec) {
+    // Copy the embedding into its arena row; the arena owns the data from now on.
+    // Without float rows it is only staged, for the codes to be computed from.
+    int slot = allocateSlot();
+    float* row = this->rowsDropped ? this->stagingRow.data() : rowAt(slot);
+    for (int i = 0; i < this->dimension; ++i) {
+        row[i] = (*vec)[i];
+    }
+    delete vec;
+
+    // Compute distance from the reference vector.
+    // for the AVL Tree
+    double distFromRef = l2Kernel(row, this->referenceVector->data(), this->dimension);
+
+    // Compute the "Euclidean norm" of the vector.
+    // for the Red-Black Tree
+    double vecNorm = 0.0;
+    for (int i = 0; i < this->dimension; ++i) {
+        vecNorm += row[i] * row[i];
+    }
+    vecNorm = sqrt(vecNorm);
+
+    // Ids come from a counter that only moves forward
+    int newId = this->nextId++;
+
+    // Create the new record in the record table
+    VectorRecord& newRecord = this->records[slot];
+    newRecord = VectorRecord(newId, rawText, slot,
+                             this->rowsDropped ? RowPointer() : RowPointer(row, this->dimension), distFromRef);
+    newRecord.norm = vecNorm;
+    packRow(slot);
+    this->idIndex->insert(newId, slot);
+
+    // Distances to the current pivots
+    for (int p = 0; p < this->pivotsChosen; ++p) {
+        this->pivotTable[(size_t)slot * this->pivotTarget + p] =
+            (float)l2Kernel(row, &this->pivotVectors[(size_t)p * this->dimension], this->dimension);
+    }
+
+    return slot;
+}
+
+// Counts a stored record: updates the average distance and the root choice
+void VectorStore::admitRecord(int slot) {
+    const VectorRecord& newRecord = this->records[slot];
+
+    // Update the average distance.
+    double totalDistance = (this->averageDistance * this->count) + newRecord.distanceFromReference;
+    int old_count = this->count;
+    this->count++; 
+    this->averageDistance = totalDistance / this->count;
+
+    // If the store is empty, sets this vector as the root vector.
+    if (old_count == 0) {
+        this->rootSlot = slot;
+    } 
+    else {
+        // Check if new vector's distance is closer to the average
+        double rootDistToAvg = fabs(this->records[this->rootSlot].distanceFromReference - this->averageDistance);
+        double newDistToAvg = fabs(newRecord.distanceFromReference - this->averageDistance);
+
+        if (newDistToAvg < rootDistToAvg) {
+            // Only the choice is recorded here; the caller re-roots the AVL
+            // (rebuildRootIfNeeded) once the record is in the tree
+            this->rootSlot = slot;
+        }
+    }
+}
+
+void VectorStore::addTexts(const vector<string>& rawTexts) {
+    vector<IndexKey> distKeys, normKeys;
+    vector<int> newSlots;
+    distKeys.reserve(rawTexts.size());
+    normKeys.reserve(rawTexts.size());
+    newSlots.reserve(rawTexts.size());
+
+    // Work in rounds of at most ingestWindow texts, so only that many
+    // embeddings are ever buffered
+    int threads = threadCount();
+    size_t window = (size_t)this->ingestWindow;
+    vector<vector<float>*> embedded;
+    vector<std::exception_ptr> errors;
+    std::exception_ptr failure;
+    for (size_t base = 0; base < rawTexts.size() && !failure; base += window) {
+        int chunk = (int)min(window, rawTexts.size() - base);
+        embedded.assign(chunk, nullptr);
+        errors.assign(chunk, nullptr);
+
+        // Embedding stage: embeddingFunction plus pad/truncate on the workers
+        parallelFor(0, chunk, threads, [&](int i) {
+            try {
+                embedded[i] = this->preprocessing(rawTexts[base + i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+
+        // Writer stage, on this thread in input order, so ids, the running
+        // average and the root choice come out exactly as with repeated
+        // addText calls. A text whose embedding threw ends the batch there,
+        // as it would have ended a sequence of addText calls.
+        for (int i = 0; i < chunk; ++i) {
+            if (failure || errors[i]) {
+                if (!failure) failure = errors[i];
+                delete embedded[i];
+                continue;
+            }
+            if (embedded[i] == nullptr) continue;
+
+            int slot = storeRecord(rawTexts[base + i], embedded[i]);
+            admitRecord(slot);
+            const VectorRecord& newRecord = this->records[slot];
+            distKeys.push_back(IndexKey(newRecord.distanceFromReference, newRecord.id));
+            normKeys.push_back(IndexKey(newRecord.norm, newRecord.id));
+            newSlots.push_back(slot);
+            const float* row = this->rowsDropped ? this->stagingRow.data() : rowAt(slot);
+            if (this->hnsw) this->hnsw->insert(slot, this->arena);
+            if (this->ivf) this->ivf->insert(slot, this->arena);
+            if (this->pq) this->pq->encode(slot, row);
+            if (this->int8Codes) this->int8Codes->encode(slot, row);
+            if (this->simHash) this->simHash->encode(slot, this->arena);
+            if (this->kdTree) this->kdTree->insert(slot, this->arena);
+        }
+    }
+
+    // Index whatever was stored before rethrowing, so the store stays consistent
+    indexBatch(distKeys, normKeys, newSlots);
+    rebuildRootIfNeeded();
+    retrainIndexesIfNeeded();
+    updatePivots();
+    if (failure) std::rethrow_exception(failure);
+}
+
+// Puts freshly stored records into both trees
+void VectorStore::indexBatch(vector<IndexKey>& distKeys, vector<IndexKey>& normKeys, vector<int>& newSlots) {
+    int batch = (int)newSlots.size();
+    if (batch == 0) return;
+
+    // A small batch into a large store: b O(log n) inserts beat an O(n) rebuild
+    int existing = this->count - batch;
+    int logExisting = 0;
+    while ((1 << logExisting) < existing) logExisting++;
+    if ((long long)batch * logExisting < existing) {
+        for (int i = 0; i < batch; ++i) {
+            this->vectorStore->insert(distKeys[i], newSlots[i]);
+            this->normIndex->insert(normKeys[i], newSlots[i]);
+        }
+        return;
+    }
+
+    // Otherwise sort the batch, merge it with each tree's in-order contents and
+    // rebuild both trees bottom-up: O(n + b log b) with no rotations.
+    // The AVL comes back unpinned; addTexts puts the chosen root back on top.
+    vector<int> distSlots = newSlots;
+    sortHandles(distKeys, distSlots);
+    vector<IndexKey> oldKeys, allKeys;
+    vector<int> oldSlots, allSlots;
+    this->vectorStore->collectSorted(oldKeys, oldSlots);
+    mergeHandles(oldKeys, oldSlots, distKeys, distSlots, allKeys, allSlots);
+    this->vectorStore->buildFromSorted(allKeys, allSlots);
+
+    sortHandles(normKeys, newSlots);
+    oldKeys.clear();
+    oldSlots.clear();
+    this->normIndex->collectSorted(oldKeys, oldSlots);
+    mergeHandles(oldKeys, oldSlots, normKeys, newSlots, allKeys, allSlots);
+    this->normIndex->buildFromSorted(allKeys, allSlots);
+}
+
+VectorRecord* VectorStore::getVector(int index) {
+    if (index < 0 || index >= this->count) {
+        throw out_of_range("Index is invalid!");
+    }
+    
+    // select() walks down by subtree sizes: O(log n)
+    return &this->records[this->vectorStore->select(index)->data];
+}
+
+string VectorStore::getRawText(int index) {
+    if (index < 0 || index >= this->count) {
+        throw out_of_range("Index is invalid!");
+    }
+    
+    int slot = this->vectorStore->select(index)->data;
+    
+    return this->records[slot].rawText;
+}
+
+int VectorStore::getId(int index) {
+    if (index < 0 || index >= this->count) {
+        throw out_of_range("Index is invalid!");
+    }
+    
+    int slot = this->vectorStore->select(index)->data;
+    
+    return this->records[slot].id;
+}
+
+bool VectorStore::removeAt(int index) {
+    if (index < 0 || index >= this->count) {
+        throw out_of_range("Index is invalid!");
+    }
+
+    removeSlot(this->vectorStore->select(index)->data);
+    return true;
+}
+
+VectorRecord* VectorStore::getById(int id) {
+    int slot = this->idIndex->find(id);
+    if (slot == -1) {
+        return nullptr;
+    }
+    return &this->records[slot];
+}
+
+bool VectorStore::containsId(int id) const {
+    return this->idIndex->find(id) != -1;
+}
+
+bool VectorStore::removeById(int id) {
+    int slot = this->idIndex->find(id);
+    if (slot == -1) {
+        return false;
+    }
+    removeSlot(slot);
+    return true;
+}
+
+// Shared by removeAt and removeById: drop the record in `slot` from every index
+void VectorStore::removeSlot(int slot) {
+    const VectorRecord& recordToRemove = this->records[slot];
+    
+    IndexKey avlKey(recordToRemove.distanceFromReference, recordToRemove.id);
+    IndexKey rbtKey(recordToRemove.norm, recordToRemove.id);
+    bool wasRoot = (slot == this->rootSlot);
+
+    // Remove from both trees and the id index
+    this->vectorStore->remove(avlKey);
+    this->normIndex->remove(rbtKey);
+    this->idIndex->erase(recordToRemove.id);
+
+    // Update average distance
+    double oldTotalDistance = this->averageDistance * this->count;
+    double newTotalDistance = oldTotalDistance - recordToRemove.distanceFromReference;
+
+    // Drop the record and hand the arena row back for reuse
+    if (this->hnsw) this->hnsw->markDeleted(slot);
+    if (this->ivf) this->ivf->remove(slot);
+    if (this->kdTree) this->kdTree->remove(slot);
+    releaseSlot(slot);
+    
+    this->count--; // Decrement count
+    if (this->pivotSelectionCount > this->count) {
+        this->pivotSelectionCount = this->count; // re-pick once the store doubles again
+    }
+    
+    if (this->count == 0) {
+        this->averageDistance = 0.0;
+    } 
+    else {
+        this->averageDistance = newTotalDistance / this->count;
+    }
+
+    // Handle root vector replacement
+    if (this->count == 0) { //store is empty
+        this->rootSlot = -1;
+    } 
+    else if (wasRoot) {
+        // The AVL is keyed by distance, so the record closest to the new
+        // average is found by one descent: O(log n).
+        this->rootSlot = findVectorNearestToDistance(this->averageDistance)->slot;
+    }
+    rebuildRootIfNeeded();
+
+    // Tombstones slow every HNSW search down: once they outnumber the live
+    // nodes, rebuild without them (O(n log n), amortized over n / 2 removals)
+    if (this->hnsw && this->hnsw->tombstones() > this->hnsw->size()) {
+        rebuildHNSW();
+    }
+    retrainIndexesIfNeeded();
+}
+
+
+// REFERENCE VECTOR AND EMBEDDING FUNCTION MANAGEMENT
+void VectorStore::setReferenceVector(const vector<float>& newReference) {
+    requireFloatRows();
+
+    delete this->referenceVector;
+    this->referenceVector = new vector<float>(newReference);
+    this->referenceVector->resize(this->dimension, 0.0f); // as in the constructor
+
+    // If the store is empty -> done
+    if (this->count == 0) {
+        return;
+    }
+
+    // Re-compute distances: one linear pass over the table
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        VectorRecord& rec = this->records[slot];
+        if (rec.id == -1) continue;
+        rec.distanceFromReference = l2Kernel(rec.vector, this->referenceVector->data(), this->dimension);
+    }
+    rekeyByDistance();
+}
+
+// After the distances of the records changed: recompute the average, pick the
+// root again and re-insert the AVL handles under the new keys
+void VectorStore::rekeyByDistance() {
+    double totalDistance = 0.0;
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id == -1) continue;
+        totalDistance += this->records[slot].distanceFromReference;
+    }
+
+    this->averageDistance = totalDistance / this->count;
+
+    // Find the new root vector (closest to average distance)
+    int newRoot = -1;
+    double minDiff = -1.0; // -1 = not set
+
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id == -1) continue;
+        double diff = fabs(this->records[slot].distanceFromReference - this->averageDistance);
+        
+        if (newRoot == -1 || diff < minDiff) {
+            minDiff = diff;
+            newRoot = slot;
+        }
+    }
+    this->rootSlot = newRoot;
+
+    // Only the AVL is keyed by distance: re-insert its handles under the new keys.
+    // The RBT is keyed by norm, which does not depend on the reference.
+    this->vectorStore->clear();
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id == -1) continue;
+        this->vectorStore->insert(IndexKey(this->records[slot].distanceFromReference, this->records[slot].id), slot);
+    }
+    rebuildRootIfNeeded();
+}
+
+vector<float>* VectorStore::getReferenceVector() const {
+    return this->referenceVector;
+}
+VectorRecord* VectorStore::getRootVector() const {
+    if (this->rootSlot == -1) {
+        return nullptr;
+    }
+    return &this->records[this->rootSlot];
+}
+double VectorStore::getAverageDistance() const {
+    return this->averageDistance;
+}
+const char* VectorStore::distanceKernelName() {
+    return distanceKernels().name;
+}
+
+// PIVOTS
+void VectorStore::setPivotCount(int pivots) {
+    if (pivots < 0) {
+        throw invalid_argument("Pivot count must be non-negative!");
+    }
+    if (pivots > 0) requireFloatRows();
+    this->pivotTarget = pivots;
+    this->pivotTable.assign((size_t)this->arenaCapacity * pivots, 0.0f);
+    selectPivots();
+}
+
+int VectorStore::getPivotCount() const {
+    return this->pivotsChosen;
+}
+
+// SUBTREE BOUNDS
+const float* VectorStore::rowOfSlot(const int& slot, const void* store) {
+    return static_cast<const VectorStore*>(store)->rowAt(slot);
+}
+
+void VectorStore::setSubtreeBoundDims(int dims) {
+    if (dims < 0 || dims > this->dimension) {
+        throw invalid_argument("Bounded dimensions must lie in [0, dimension]!");
+    }
+    if (dims > 0) requireFloatRows();
+    this->vectorStore->setBounds(dims, rowOfSlot, this);
+}
+
+int VectorStore::getSubtreeBoundDims() const {
+    return this->vectorStore->getBoundDims();
+}
+
+// Re-pick the pivots whenever the store has doubled since the last pick:
+// O(n * P * d) each time, so O(P * d) amortized per insert
+void VectorStore::updatePivots() {
+    if (this->pivotTarget > 0 && this->count >= 2 * this->pivotSelectionCount) {
+        selectPivots();
+    }
+}
+
+// Farthest-first (max-spread) selection: start from the record farthest from
+// the reference vector, then repeatedly take the record farthest from every
+// pivot chosen so far. The distances computed along the way are the table.
+void VectorStore::selectPivots() {
+    this->pivotVectors.clear();
+    this->pivotsChosen = 0;
+    this->pivotSelectionCount = this->count;
+    if (this->pivotTarget == 0 || this->count == 0) return;
+
+    vector<int> live;
+    live.reserve(this->count);
+    int next = -1;
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id == -1) continue; // free slot
+        live.push_back(slot);
+        if (next == -1 || this->records[slot].distanceFromReference > this->records[next].distanceFromReference) {
+            next = slot;
+        }
+    }
+
+    vector<double> nearestPivot(live.size(), 1.0e300);
+    while (this->pivotsChosen < this->pivotTarget) {
+        const float* pivot = rowAt(next);
+        this->pivotVectors.insert(this->pivotVectors.end(), pivot, pivot + this->dimension);
+        int p = this->pivotsChosen++;
+        pivot = &this->pivotVectors[(size_t)p * this->dimension]; // the copy outlives the slot
+
+        int farthest = -1;
+        for (size_t i = 0; i < live.size(); ++i) {
+            double d = l2Kernel(rowAt(live[i]), pivot, this->dimension);
+            this->pivotTable[(size_t)live[i] * this->pivotTarget + p] = (float)d;
+            if (d < nearestPivot[i]) nearestPivot[i] = d;
+            if (farthest == -1 || nearestPivot[i] > nearestPivot[farthest]) farthest = (int)i;
+        }
+        if (nearestPivot[farthest] == 0.0) break; // every record coincides with a pivot
+        next = live[farthest];
+    }
+}
+
+// HNSW GRAPH INDEX
+void VectorStore::enableHNSW(Metric metric, int M, int efConstruction) {
+    if (M < 2 || efConstruction < 1) {
+        throw invalid_argument("HNSW needs M >= 2 and efConstruction >= 1!");
+    }
+    requireFloatRows();
+    disableHNSW();
+    this->hnsw = new HNSWIndex(metric, this->dimension, M, efConstruction);
+    rebuildHNSW();
+}
+
+void VectorStore::disableHNSW() {
+    delete this->hnsw;
+    this->hnsw = nullptr;
+    // Rows held for the graph can be reused now
+    this->freeSlots.insert(this->freeSlots.end(), this->hnswPendingSlots.begin(), this->hnswPendingSlots.end());
+    this->hnswPendingSlots.clear();
+}
+
+void VectorStore::setEfSearch(int ef) {
+    if (ef < 1) {
+        throw invalid_argument("efSearch must be positive!");
+    }
+    this->hnswEfSearch = ef;
 }
-double VectorStore::getAverageDistance() const {
-    return this->averageDistance;
+
+// Re-inserts every live slot, in slot order, into an empty graph
+void VectorStore::rebuildHNSW() {
+    this->hnsw->clear();
+    this->freeSlots.insert(this->freeSlots.end(), this->hnswPendingSlots.begin(), this->hnswPendingSlots.end());
+    this->hnswPendingSlots.clear();
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id == -1) continue; // free slot
+        this->hnsw->insert(slot, this->arena);
+    }
+}
+
+// Ids of the k records the graph finds closest to query, closest first.
+// found = how many it reached; the rest of the k entries are -1.
+int* VectorStore::searchHNSW(const vector<float>& query, int k, Metric metric, int& found) {
+    if (this->hnsw == nullptr || this->hnsw->getMetric() != metric) {
+        throw invalid_metric(); // the graph only answers the metric it was built for
+    }
+    if ((int)query.size() != this->dimension) {
+        throw invalid_argument("Query dimension does not match the store!");
+    }
+    int evaluated = 0;
+    vector<pair<double, int>> hits = this->hnsw->search(query.data(), k, this->hnswEfSearch, this->arena, evaluated);
+    this->lastDistanceEvaluations = evaluated;
+
+    found = (int)hits.size();
+    int* ids = new int[k];
+    for (int i = 0; i < k; ++i) {
+        ids[i] = (i < found) ? this->records[hits[i].second].id : -1;
+    }
+    return ids;
+}
+
+// INVERTED FILE INDEX
+void VectorStore::enableIVF(Metric metric, int nlist) {
+    if (nlist < 1) {
+        throw invalid_argument("IVF needs at least one cell!");
+    }
+    requireFloatRows();
+    disableIVF();
+    this->ivf = new IVFIndex(metric, this->dimension, nlist);
+    trainIVF();
+}
+
+void VectorStore::disableIVF() {
+    delete this->ivf;
+    this->ivf = nullptr;
+}
+
+void VectorStore::setNProbe(int nprobe) {
+    if (nprobe < 1) {
+        throw invalid_argument("nprobe must be positive!");
+    }
+    this->ivfProbes = nprobe;
+}
+
+// Mini-batch k-means, then one full Lloyd step: every centroid moves to the
+// mean of its cell (computeCentroid) and the records are assigned again
+void VectorStore::trainIVF() {
+    vector<int> live;
+    live.reserve(this->count);
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id != -1) live.push_back(slot);
+    }
+    int threads = threadCount();
+    this->ivf->train(this->arena, live, threads);
+    this->ivf->assign(this->arena, live, threads);
+
+    vector<VectorRecord*> members;
+    for (int cell = 0; cell < this->ivf->cellCount(); ++cell) {
+        const vector<int>& list = this->ivf->postingList(cell);
+        if (list.empty()) continue;
+        members.clear();
+        for (int slot : list) members.push_back(&this->records[slot]);
+        VectorRecord centroid = computeCentroid(members);
+        this->ivf->setCentroid(cell, centroid.vector);
+        delete[] centroid.vector;
+    }
+    this->ivf->assign(this->arena, live, threads);
+}
+
+// QUANTIZED ROWS (PQ / INT8)
+void VectorStore::enablePQ(int subspaces) {
+    if (subspaces < 1 || subspaces > this->dimension) {
+        throw invalid_argument("PQ needs between 1 and dimension subspaces!");
+    }
+    requireFloatRows(); // training reads the rows
+    disablePQ();
+    this->pq = new ProductQuantizer(this->dimension, subspaces);
+    trainPQ();
+}
+
+void VectorStore::disablePQ() {
+    if (this->rowsDropped && this->pq && !this->int8Codes) {
+        throw logic_error("The PQ codes are the only copy of the float rows!");
+    }
+    delete this->pq;
+    this->pq = nullptr;
+}
+
+void VectorStore::enableInt8() {
+    requireFloatRows();
+    disableInt8();
+    this->int8Codes = new ScalarQuantizer(this->dimension);
+    trainInt8();
+}
+
+void VectorStore::disableInt8() {
+    if (this->rowsDropped && this->int8Codes && !this->pq) {
+        throw logic_error("The int8 codes are the only copy of the float rows!");
+    }
+    delete this->int8Codes;
+    this->int8Codes = nullptr;
+}
+
+void VectorStore::trainInt8() {
+    vector<int> live;
+    live.reserve(this->count);
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id != -1) live.push_back(slot);
+    }
+    this->int8Codes->train(this->arena, live, threadCount());
+}
+
+void VectorStore::setRerankDepth(int candidates) {
+    if (candidates < 0) {
+        throw invalid_argument("Re-rank depth must be non-negative!");
+    }
+    this->rerankDepth = candidates;
+}
+
+void VectorStore::dropFloatRows() {
+    if (this->rowsDropped) return;
+    if (this->pq == nullptr && this->int8Codes == nullptr) {
+        throw invalid_argument("Neither PQ nor int8 quantization is enabled!");
+    }
+    if ((this->pq && !this->pq->trained()) || (this->int8Codes && !this->int8Codes->trained())) {
+        throw logic_error("The quantized codes are not trained yet!");
+    }
+    if (this->hnsw || this->ivf || this->simHash || this->kdTree || this->pivotTarget > 0
+        || this->vectorStore->getBoundDims() > 0 || this->precision != FP32) {
+        throw logic_error("Disable the indexes that read the float rows first!");
+    }
+    ::operator delete(this->arena, std::align_val_t(ARENA_ALIGNMENT));
+    this->arena = nullptr;
+    this->rowsDropped = true;
+    this->stagingRow.assign(this->dimension, 0.0f);
+    for (int slot = 0; slot < this->arenaSize; ++slot) this->records[slot].vector = RowPointer();
+}
+
+bool VectorStore::hasFloatRows() const {
+    return !this->rowsDropped;
+}
+
+void VectorStore::requireFloatRows() const {
+    if (this->rowsDropped) {
+        throw logic_error("The float rows were dropped!");
+    }
+}
+
+// SIMHASH SIGNATURES
+void VectorStore::enableSimHash(int bits) {
+    if (bits < 64 || bits % 64 != 0) {
+        throw invalid_argument("SimHash needs a positive multiple of 64 bits!");
+    }
+    requireFloatRows();
+    disableSimHash();
+    this->simHash = new SimHasher(this->dimension, bits);
+    encodeSimHash();
+}
+
+void VectorStore::disableSimHash() {
+    delete this->simHash;
+    this->simHash = nullptr;
+}
+
+void VectorStore::setSimHashCandidates(int candidates) {
+    if (candidates < 0) {
+        throw invalid_argument("SimHash candidates must be non-negative!");
+    }
+    this->simHashCandidates = candidates;
+}
+
+void VectorStore::encodeSimHash() {
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id != -1) this->simHash->encode(slot, this->arena);
+    }
+}
+
+// K-D TREE
+void VectorStore::enableKDTree(int leafSize) {
+    if (leafSize < 1) {
+        throw invalid_argument("K-d tree leaf size must be positive!");
+    }
+    requireFloatRows();
+    disableKDTree();
+    this->kdTree = new KDTree(this->dimension, leafSize);
+    rebuildKDTree();
 }
+
+void VectorStore::disableKDTree() {
+    delete this->kdTree;
+    this->kdTree = nullptr;
+}
+
+void VectorStore::rebuildKDTree() {
+    vector<int> live;
+    live.reserve(this->count);
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id != -1) live.push_back(slot);
+    }
+    this->kdTree->build(this->arena, live);
+}
+
+void VectorStore::trainPQ() {
+    vector<int> live;
+    live.reserve(this->count);
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        if (this->records[slot].id != -1) live.push_back(slot);
+    }
+    this->pq->train(this->arena, live, threadCount());
+}
+
+void VectorStore::retrainIndexesIfNeeded() {
+    if (this->ivf && this->ivf->needsRetraining(this->count)) {
+        trainIVF();
+    }
+    // Without float rows there is nothing to retrain from: the codes stay as trained
+    if (this->pq && !this->rowsDropped && this->pq->needsRetraining(this->count)) {
+        trainPQ();
+    }
+    if (this->int8Codes && !this->rowsDropped && this->int8Codes->needsRetraining(this->count)) {
+        trainInt8();
+    }
+}
+
+// STORAGE PRECISION
+void VectorStore::setStoragePrecision(StoragePrecision newPrecision) {
+    if (newPrecision == this->precision) return;
+    requireFloatRows();
+    this->precision = newPrecision;
+    if (newPrecision == FP32) {
+        // The float rows already hold the rounded values: only the copies go
+        for (int slot = 0; slot < this->arenaSize; ++slot) this->records[slot].packed = nullptr;
+        vector<unsigned short>().swap(this->packedRows);
+        return;
+    }
+    this->packedRows.assign((size_t)this->arenaCapacity * this->dimension, 0);
+    if (this->count == 0) return;
+
+    // Round every stored row once, then redo what was derived from the rows:
+    // norms (and the RBT) here, distances (and the AVL) in setReferenceVector
+    this->normIndex->clear();
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        VectorRecord& rec = this->records[slot];
+        if (rec.id == -1) continue;
+        float* row = rowAt(slot);
+        double vecNorm = 0.0;
+        for (int i = 0; i < this->dimension; ++i) {
+            row[i] = roundToPrecision(row[i], newPrecision);
+            vecNorm += row[i] * row[i];
+        }
+        rec.norm = sqrt(vecNorm);
+        this->normIndex->insert(IndexKey(rec.norm, rec.id), slot);
+        packRow(slot);
+    }
+    vector<float> reference(*this->referenceVector);
+    setReferenceVector(reference);
+    selectPivots();
+    if (this->hnsw) rebuildHNSW();
+    if (this->ivf) trainIVF();
+    if (this->pq) trainPQ();
+    if (this->int8Codes) trainInt8();
+    if (this->simHash) encodeSimHash();
+    if (this->kdTree) rebuildKDTree();
+}
+
+StoragePrecision VectorStore::getStoragePrecision() const {
+    return this->precision;
+}
+
+int VectorStore::getLastDistanceEvaluations() const {
+    return this->lastDistanceEvaluations;
+}
+
+void VectorStore::setWorkerThreads(int threads) {
+    if (threads < 0) {
+        throw invalid_argument("Thread count must be non-negative!");
+    }
+    this->workerThreads = threads;
+}
+
+void VectorStore::setIngestWindow(int texts) {
+    if (texts < 1) {
+        throw invalid_argument("Ingest window must be positive!");
+    }
+    this->ingestWindow = texts;
+}
+
+int VectorStore::threadCount() const {
+#ifdef VECTORSTORE_THREADS
+    if (this->workerThreads > 0) return this->workerThreads;
+    int hardware = (int)std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+#else
+    return 1;
+#endif
+}
+
 void VectorStore::setEmbeddingFunction(vector<float>* (*newEmbeddingFunction)(const string&)) {
     this->embeddingFunction = newEmbeddingFunction;
 }
 
 // TRAVERSAL AND ITERATION
-static void inorder_helper(AVLTree<double, VectorRecord>::AVLNode* node, void (*action)(vector<float>&, int, string&)){
+static void inorder_helper(AVLTree<IndexKey, int>::AVLNode* node, VectorRecord* records, int dimension, void (*action)(vector<float>&, int, string&)){
     if (node == nullptr) return;
     // left -> action -> right
-    inorder_helper(node->pLeft, action);
-    action(*(node->data.vector), node->data.id, node->data.rawText);
-    inorder_helper(node->pRight, action);
+    inorder_helper(node->pLeft, records, dimension, action);
+    // action works on a std::vector: copy the arena row out and write any changes back
+    VectorRecord& rec = records[node->data];
+    vector<float> values = *rec.vector;
+    action(values, rec.id, rec.rawText);
+    for (int i = 0; i < dimension && i < (int)values.size(); ++i) {
+        rec.vector[i] = values[i];
+    }
+    inorder_helper(node->pRight, records, dimension, action);
 }
 
 void VectorStore::forEach(void (*action)(vector<float>&, int, string&)) {
-    
-    inorder_helper(this->vectorStore->getRoot(), action);
+    requireFloatRows();
+    inorder_helper(this->vectorStore->getRoot(), this->records, this->dimension, action);
+
+    // Rows written back are rounded again and their 16-bit copies refreshed.
+    // Cosine divides by the cached norm: recompute it and re-key the RBT.
+    // The AVL is keyed by the distance to the reference: recompute it too.
+    bool distancesChanged = false;
+    for (int slot = 0; slot < this->arenaSize; ++slot) {
+        VectorRecord& rec = this->records[slot];
+        if (rec.id == -1) continue;
+        float* row = rowAt(slot);
+        if (this->precision != FP32) {
+            for (int i = 0; i < this->dimension; ++i) row[i] = roundToPrecision(row[i], this->precision);
+            packRow(slot);
+        }
+        double vecNorm = 0.0;
+        for (int i = 0; i < this->dimension; ++i) {
+            vecNorm += row[i] * row[i];
+        }
+        vecNorm = sqrt(vecNorm);
+        if (vecNorm != rec.norm) {
+            this->normIndex->remove(IndexKey(rec.norm, rec.id));
+            rec.norm = vecNorm;
+            this->normIndex->insert(IndexKey(rec.norm, rec.id), slot);
+        }
+        double distance = l2Kernel(row, this->referenceVector->data(), this->dimension);
+        if (distance != rec.distanceFromReference) {
+            rec.distanceFromReference = distance;
+            distancesChanged = true;
+        }
+    }
+    if (distancesChanged) rekeyByDistance();
+    // The pivot table holds distances from the old rows: pick and measure again
+    if (this->pivotsChosen > 0) selectPivots();
+    // The rows may have moved: the tree's splits and the AVL's boxes no longer describe them
+    if (this->kdTree) rebuildKDTree();
+    if (this->vectorStore->getBoundDims() > 0) this->vectorStore->refreshBounds();
+    // The graph's links were chosen by the old distances
+    if (this->hnsw) rebuildHNSW();
+    // Centroids and posting lists describe the old rows: retrain and reassign
+    if (this->ivf && this->count > 0) trainIVF();
+    // Codebooks learned from the old rows: learn them again and re-encode every row
+    if (this->pq && this->count > 0) trainPQ();
+    // Same for the int8 ranges, the codes and their per-row terms
+    if (this->int8Codes && this->count > 0) trainInt8();
+    // Signatures are signs of the old rows' projections
+    if (this->simHash) encodeSimHash();
 }
 
-static void inorder_getid_helper(AVLTree<double, VectorRecord>::AVLNode* node, vector<int>& idVector){
+static void inorder_getid_helper(AVLTree<IndexKey, int>::AVLNode* node, const VectorRecord* records, vector<int>& idVector){
     if (node == nullptr) return;
    
-    inorder_getid_helper(node->pLeft, idVector);
+    inorder_getid_helper(node->pLeft, records, idVector);
     
-    idVector.push_back(node->data.id); // Add the ID
+    idVector.push_back(records[node->data].id); // Add the ID
     
-    inorder_getid_helper(node->pRight, idVector);
+    inorder_getid_helper(node->pRight, records, idVector);
 }
 vector<int> VectorStore::getAllIdsSortedByDistance() const {
     vector<int> ids;
     if (this->count > 0) {
         ids.reserve(this->count); // Optimize allocation
-        inorder_getid_helper(this->vectorStore->getRoot(), ids);
+        inorder_getid_helper(this->vectorStore->getRoot(), this->records, ids);
+    }
+    return ids;
+}
+
+static void inorder_getVector_helper(AVLTree<IndexKey, int>::AVLNode* node, VectorRecord* records, vector<VectorRecord*>& recordVector)
+{
+    if (node == nullptr) return;
+
+    inorder_getVector_helper(node->pLeft, records, recordVector);
+    
+    // Add a pointer to the VectorRecord in the record table
+    recordVector.push_back(&records[node->data]);
+    
+    inorder_getVector_helper(node->pRight, records, recordVector);
+}
+
+vector<VectorRecord*> VectorStore::getAllVectorsSortedByDistance() const {
+
+    vector<VectorRecord*> records;
+    if (this->count > 0) {
+        records.reserve(this->count); // Optimize allocation
+        
+        inorder_getVector_helper(this->vectorStore->getRoot(), this->records, records);
+    }
+    return records;
+}
+
+
+
+
+// DISTANCE METRICS
+double VectorStore::cosineSimilarity(const vector<float>& v1, const vector<float>& v2) {
+    if (v1.size() != v2.size() || v1.empty()) {
+        return 0.0; // Or handle error
+    }
+    return cosineKernel(v1.data(), v2.data(), (int)v1.size());
+}
+// Manhattan Distance (L1)
+double VectorStore::l1Distance(const vector<float>& v1, const vector<float>& v2) {
+    if(v1.size() != v2.size() || v1.empty()) {
+        return 0.0; // Or handle error
+    }
+    return l1Kernel(v1.data(), v2.data(), (int)v1.size());
+}
+// Euclidean Distance (L2)
+double VectorStore::l2Distance(const vector<float>& v1, const vector<float>& v2) {
+    if(v1.size() != v2.size() || v1.empty()) {
+        return 0.0; // Or handle error
+    }
+    return l2Kernel(v1.data(), v2.data(), (int)v1.size());
+}
+
+// Same metrics against a stored arena row
+double VectorStore::cosineToRow(const vector<float>& v, const float* row) const {
+    if ((int)v.size() != this->dimension || v.empty()) {
+        return 0.0;
+    }
+    return cosineKernel(v.data(), row, this->dimension);
+}
+double VectorStore::l1ToRow(const vector<float>& v, const float* row) const {
+    if ((int)v.size() != this->dimension || v.empty()) {
+        return 0.0;
+    }
+    return l1Kernel(v.data(), row, this->dimension);
+}
+double VectorStore::l2ToRow(const vector<float>& v, const float* row) const {
+    if ((int)v.size() != this->dimension || v.empty()) {
+        return 0.0;
+    }
+    return l2Kernel(v.data(), row, this->dimension);
+}
+
+// ESTIMATING THRESHOLD D FROM k
+double VectorStore::estimateD_Linear(
+    const vector<float>& query, 
+    int k, 
+    double averageDistance, 
+    const vector<float>& reference, 
+    double c0_bias, 
+    double c1_slope) 
+{
+    // Formula: D = |dr - averageDistance| + c1_slope * averageDistance * k + c0_bias
+    double dr = l2Distance(query, reference);
+    double D = fabs(dr - averageDistance) + (c1_slope * averageDistance * k) + c0_bias;
+    return D;
+}
+ 
+// METRIC POLICIES
+// A MetricScorer<M> is built once per query: it resolves the distance kernel
+// and the comparison direction up front, so scan loops are instantiated per
+// metric and do no string compares or metric branches per candidate.
+Metric parseMetric(const string& name) {
+    if (name == "euclidean") return EUCLIDEAN;
+    if (name == "manhattan") return MANHATTAN;
+    if (name == "cosine") return COSINE;
+    throw invalid_metric("Invalid metric");
+}
+
+typedef double (*DistanceFn)(const float*, const float*, int);
+typedef double (*PackedDistanceFn)(const float*, const unsigned short*, int);
+
+static const PackedKernels& packedKernels(StoragePrecision precision) {
+    return precision == FP16 ? distanceKernels().fp16 : distanceKernels().bf16;
+}
+
+template <Metric M> struct MetricPolicy;
+template <> struct MetricPolicy<EUCLIDEAN> {
+    static const bool maximize = false; // distance: smaller is closer
+    static DistanceFn kernel() { return distanceKernels().l2; }
+    static PackedDistanceFn packedKernel(StoragePrecision precision) { return packedKernels(precision).l2; }
+};
+template <> struct MetricPolicy<MANHATTAN> {
+    static const bool maximize = false;
+    static DistanceFn kernel() { return distanceKernels().l1; }
+    static PackedDistanceFn packedKernel(StoragePrecision precision) { return packedKernels(precision).l1; }
+};
+template <> struct MetricPolicy<COSINE> {
+    static const bool maximize = true;  // similarity: larger is closer
+    // Only the dot product: the norms come from the query (once) and the record cache
+    static DistanceFn kernel() { return distanceKernels().dot; }
+    static PackedDistanceFn packedKernel(StoragePrecision precision) { return packedKernels(precision).dot; }
+};
+
+// A query whose size does not match the store scores 0 against every row,
+// as the *ToRow helpers do
+static double zeroKernel(const float*, const float*, int) {
+    return 0.0;
+}
+
+template <Metric M>
+class MetricScorer {
+public:
+    static const bool maximize = MetricPolicy<M>::maximize;
+
+    // precision: the store's; below FP32 records are scored from their 16-bit rows.
+    // knownNorm: the query's norm if the caller already has it (< 0 = compute it here)
+    MetricScorer(const vector<float>& query, int dimension, StoragePrecision precision, double knownNorm = -1.0)
+        : query(query.data()), dimension(dimension),
+          kernel(((int)query.size() == dimension && !query.empty()) ? MetricPolicy<M>::kernel() : zeroKernel),
+          packedKernel((kernel != zeroKernel && precision != FP32) ? MetricPolicy<M>::packedKernel(precision) : nullptr),
+          queryNorm(knownNorm) {
+        if constexpr (M == COSINE) {
+            if (queryNorm < 0.0) {
+                queryNorm = 0.0;
+                for (float val : query) queryNorm += val * val;
+                queryNorm = sqrt(queryNorm);
+            }
+        }
+    }
+
+    double operator()(const VectorRecord& rec) const {
+        if constexpr (M == COSINE) {
+            // One dot product per candidate; rec.norm was cached by addText
+            if (queryNorm == 0.0 || rec.norm == 0.0) return 0.0;
+            return rowScore(rec) / (queryNorm * rec.norm);
+        }
+        return rowScore(rec);
+    }
+
+    // Is score a strictly closer than score b?
+    static bool closer(double a, double b) { return maximize ? a > b : a < b; }
+    // Does score lie inside the query radius (a similarity floor for cosine)?
+    static bool within(double score, double radius) { return maximize ? score >= radius : score <= radius; }
+
+private:
+    double rowScore(const VectorRecord& rec) const {
+        return packedKernel ? packedKernel(query, rec.packed, dimension) : kernel(query, rec.vector, dimension);
+    }
+
+    const float* query;
+    int dimension;
+    DistanceFn kernel;
+    PackedDistanceFn packedKernel;      // nullptr: score the float rows
+    double queryNorm;                   // cosine only
+};
+
+// Heap order that keeps the farthest (score, id) pair on top
+template <Metric M>
+struct FarthestOnTop {
+    bool operator()(const pair<double, int>& a, const pair<double, int>& b) const {
+        return MetricPolicy<M>::maximize ? a > b : a < b;
+    }
+};
+
+// Slack every pruning test grants a bound of the given magnitude before it
+// rules a record out. The SIMD kernels sum in float lanes (about 1e-6
+// relative error) and the pivot table is stored in floats, so pivots, the
+// exact band, the AVL annulus and the subtree bounds all allow this much.
+static const double ROUNDING_SLACK = 1e-6;
+
+static double roundingSlack(double magnitude) {
+    return ROUNDING_SLACK * magnitude + 1e-12;
+}
+
+// LAESA lower bound. For every pivot p, d(q, x) >= |d(q, p) - d(x, p)| in L2,
+// and L1 >= L2, so the largest such gap over all pivots bounds both metrics
+// from below: a record whose bound already loses needs no exact distance.
+// Each gap is shrunk by roundingSlack to absorb float rounding in the
+// kernels and the float table. Inactive (bound 0) without pivots or when the
+// query does not match the store's dimension.
+class PivotFilter {
+public:
+    PivotFilter(const vector<float>& query, const vector<float>& pivotVectors, int pivots,
+                const float* table, int stride, int dimension)
+        : table(table), stride(stride), pivots(pivots) {
+        if ((int)query.size() != dimension || query.empty()) this->pivots = 0;
+        queryToPivot.resize(this->pivots);
+        for (int p = 0; p < this->pivots; ++p) {
+            queryToPivot[p] = l2Kernel(query.data(), &pivotVectors[(size_t)p * dimension], dimension);
+        }
+    }
+
+    bool active() const { return pivots > 0; }
+
+    double lowerBound(int slot) const {
+        const float* row = table + (size_t)slot * stride;
+        double bound = 0.0;
+        for (int p = 0; p < pivots; ++p) {
+            double gap = fabs(queryToPivot[p] - row[p]) - roundingSlack(queryToPivot[p] + row[p]);
+            if (gap > bound) bound = gap;
+        }
+        return bound;
+    }
+
+private:
+    vector<double> queryToPivot;
+    const float* table;
+    int stride;
+    int pivots;
+};
+
+PivotFilter VectorStore::pivotFilterFor(const vector<float>& query) const {
+    return PivotFilter(query, this->pivotVectors, this->pivotsChosen, this->pivotTable.data(),
+                       this->pivotTarget, this->dimension);
+}
+
+// Keeps the k closest (score, id) pairs offered so far. A pair only displaces
+// the current farthest if its score is strictly closer, so on ties the pair
+// offered first stays.
+template <Metric M>
+class TopKHeap {
+public:
+    explicit TopKHeap(int k) : k(k) {}
+
+    void offer(double score, int id) {
+        if (heap.size() < (size_t)k) {
+            heap.push({score, id});
+        } else if (MetricScorer<M>::closer(score, heap.top().first)) {
+            heap.pop();
+            heap.push({score, id});
+        }
+    }
+    int size() const { return (int)heap.size(); }
+    double farthestScore() const { return heap.top().first; }
+    // Empties the heap into ids[0 .. size()), closest first
+    void drain(int* ids) {
+        // Pop farthest first -> fill from the back
+        for (int i = (int)heap.size() - 1; i >= 0; i--) {
+            ids[i] = heap.top().second; // {score, id}
+            heap.pop();
+        }
+    }
+
+private:
+    int k;
+    priority_queue<pair<double, int>, vector<pair<double, int>>, FarthestOnTop<M>> heap;
+};
+
+// NEAREST NEIGHBOR SEARCH
+template <Metric M>
+static int scanNearest(const vector<float>& query, const VectorRecord* records, int slots, int dimension,
+                       StoragePrecision precision, const PivotFilter& pivots, int threads, int& evaluated) {
+    MetricScorer<M> score(query, dimension, precision);
+    const double worst = MetricScorer<M>::maximize ? -2.0 : 1.0e30; // cosine lies in [-1, 1]
+
+    // Each part streams through its own run of slots (rows are contiguous in the arena)
+    int parts = partitionCount(slots, threads);
+    vector<double> bestDistance(parts, worst);
+    vector<int> bestId(parts, -1);
+    vector<int> partEvaluated(parts, 0);
+    parallelFor(0, parts, parts, [&](int part) {
+        int begin = (int)((long long)slots * part / parts);
+        int end = (int)((long long)slots * (part + 1) / parts);
+        for (int slot = begin; slot < end; ++slot) {
+            const VectorRecord& currentRecord = records[slot];
+            if (currentRecord.id == -1) continue; // free slot
+            if constexpr (M != COSINE) {
+                // Cannot be strictly closer than the best so far
+                if (pivots.active() && bestId[part] != -1 && pivots.lowerBound(slot) >= bestDistance[part]) continue;
+            }
+
+            partEvaluated[part]++;
+            double currentDistance = score(currentRecord);
+            if (MetricScorer<M>::closer(currentDistance, bestDistance[part])) {
+                bestDistance[part] = currentDistance;
+                bestId[part] = currentRecord.id;
+            }
+        }
+    });
+
+    // Merge in slot order with the same strict test, so ties still go to the
+    // lowest slot, as in one sequential pass
+    double best = worst;
+    int bestOverall = -1;
+    evaluated = 0;
+    for (int part = 0; part < parts; ++part) {
+        evaluated += partEvaluated[part];
+        if (bestId[part] != -1 && MetricScorer<M>::closer(bestDistance[part], best)) {
+            best = bestDistance[part];
+            bestOverall = bestId[part];
+        }
+    }
+    return bestOverall;
+}
+
+int VectorStore::findNearest(const vector<float>& query, string metric){
+    if(this->empty()){
+        return -1; // Store is empty
+    }
+    return findNearest(query, parseMetric(metric));
+}
+
+int VectorStore::findNearest(const vector<float>& query, Metric metric, SearchMode mode){
+    if(this->empty()){
+        return -1; // Store is empty
+    }
+
+    if (mode == HNSW || mode == IVF || mode == PQ || mode == INT8 || mode == SIMHASH) {
+        int found = 0;
+        int* ids = (mode == HNSW) ? searchHNSW(query, 1, metric, found)
+                 : (mode == IVF)  ? searchIVF(query, 1, metric, found)
+                 : (mode == PQ)   ? searchPQ(query, 1, metric)
+                 : (mode == INT8) ? searchInt8(query, 1, metric)
+                 : searchSimHash(query, 1, metric);
+        int bestId = ids[0];
+        delete[] ids;
+        return bestId;
+    }
+
+    requireFloatRows();
+    PivotFilter pivots = pivotFilterFor(query);
+    int threads = threadCount();
+    int evaluated = 0;
+    int bestId;
+    switch (metric) {
+        case EUCLIDEAN: bestId = scanNearest<EUCLIDEAN>(query, this->records, this->arenaSize, this->dimension, this->precision, pivots, threads, evaluated); break;
+        case MANHATTAN: bestId = scanNearest<MANHATTAN>(query, this->records, this->arenaSize, this->dimension, this->precision, pivots, threads, evaluated); break;
+        case COSINE:    bestId = scanNearest<COSINE>(query, this->records, this->arenaSize, this->dimension, this->precision, pivots, threads, evaluated); break;
+        default: throw invalid_metric("Invalid metric");
+    }
+    this->lastDistanceEvaluations = evaluated;
+    return bestId;
+}
+
+
+// Helper function to collect candidates within [minNorm, maxNorm]
+static void collectCandidates(
+    RedBlackTree<IndexKey, int>::RBTNode* node,
+    double minNorm, double maxNorm,
+    vector<int>& candidates)
+{
+    if (node == nullptr) {
+        return;
+    }
+    //check left (equal norms may sit on either side)
+    if (node->key.value >= minNorm) {
+        collectCandidates(node->left, minNorm, maxNorm, candidates);
+    }
+    // if the current node is in range, add it.
+    if (node->key.value >= minNorm && node->key.value <= maxNorm) {
+        candidates.push_back(node->data);
+    }
+    //check right
+    if (node->key.value <= maxNorm) {
+        collectCandidates(node->right, minNorm, maxNorm, candidates);
+    }
+}
+// Would this record's exact distance be wasted? True when the heap is full
+// and the pivot bound shows it cannot be strictly closer than the kth best.
+template <Metric M>
+static bool prunedByPivots(const PivotFilter& pivots, const TopKHeap<M>& heap, int k, int slot) {
+    if constexpr (M == COSINE) {
+        return false;
+    } else {
+        return pivots.active() && heap.size() == k && pivots.lowerBound(slot) >= heap.farthestScore();
+    }
+}
+
+// Keeps the k closest candidates; the result is ordered closest first
+template <Metric M>
+static int* selectTopK(const vector<float>& query, double queryNorm, int k, const vector<int>& candidates,
+                       const VectorRecord* records, int dimension, StoragePrecision precision,
+                       const PivotFilter& pivots, int& evaluated) {
+    MetricScorer<M> score(query, dimension, precision, queryNorm);
+    TopKHeap<M> heap(k);
+
+    evaluated = 0;
+    for (int slot : candidates) {
+        if (prunedByPivots(pivots, heap, k, slot)) continue;
+        const VectorRecord* rec = &records[slot];
+        heap.offer(score(*rec), rec->id);
+        evaluated++;
     }
-    return ids;
+    int* top_ids = new int[heap.size()];
+    heap.drain(top_ids);
+    return top_ids;
 }
 
-static void inorder_getVector_helper(AVLTree<double, VectorRecord>::AVLNode* node, vector<VectorRecord*>& recordVector)
-{
-    if (node == nullptr) return;
+// Exact top-k for the distance metrics. Every record x satisfies
+// |‖q‖ − ‖x‖| ≤ ‖q − x‖₂ ≤ ‖q − x‖₁, so once k candidates are scored and the
+// kth-best distance is within the searched norm band [‖q‖ − r, ‖q‖ + r],
+// nothing outside the band can do better. Otherwise the band grows (to the
+// kth-best distance, or doubles while fewer than k were found) and only the
+// newly covered records are scored (or ruled out by the pivots).
+// `evaluated` receives the number of exact distances computed.
+template <Metric M>
+static int* selectTopKExact(const vector<float>& query, double queryNorm, double radius, int k, int total,
+                            RedBlackTree<IndexKey, int>::RBTNode* rbtRoot,
+                            const VectorRecord* records, int dimension, StoragePrecision precision,
+                            const PivotFilter& pivots, int& evaluated) {
+    MetricScorer<M> score(query, dimension, precision, queryNorm);
+    TopKHeap<M> heap(k);
+    double doneLo = 0.0, doneHi = -1.0; // norm band already scored (empty)
+    vector<int> candidates;
+    int scored = 0;
+    evaluated = 0;
+    if (radius < 0.0) radius = 0.0;
+
+    while (true) {
+        candidates.clear();
+        collectCandidates(rbtRoot, queryNorm - radius, queryNorm + radius, candidates);
+        for (int slot : candidates) {
+            const VectorRecord& rec = records[slot];
+            if (rec.norm >= doneLo && rec.norm <= doneHi) continue; // scored in an earlier round
+            scored++;
+            if (prunedByPivots(pivots, heap, k, slot)) continue;
+            heap.offer(score(rec), rec.id);
+            evaluated++;
+        }
+        doneLo = queryNorm - radius;
+        doneHi = queryNorm + radius;
+
+        if (scored == total) break;
+        if (heap.size() == k) {
+            double kth = heap.farthestScore();
+            if (kth <= radius) break;
+            // Slack for float rounding in the kernels and the cached norms
+            radius = kth + roundingSlack(kth);
+        } else {
+            radius = (radius > 0.0) ? 2.0 * radius : 1.0;
+        }
+    }
 
-    inorder_getVector_helper(node->pLeft, recordVector);
-    
-    // Add a pointer to the VectorRecord data inside the AVL node
-    recordVector.push_back(&(node->data));
-    
-    inorder_getVector_helper(node->pRight, recordVector);
+    int* top_ids = new int[heap.size()];
+    heap.drain(top_ids);
+    return top_ids;
 }
 
-vector<VectorRecord*> VectorStore::getAllVectorsSortedByDistance() const {
+// Batched top-k, blocked like a matrix product: candidates are walked in
+// blocks small enough to stay in cache, and each block is scored against
+// every query of a tile before moving on. Every query still sees exactly its
+// own norm band [lo, hi], in the same (norm-sorted) order as topKNearest, so
+// the results are identical to one call per query.
+template <Metric M>
+static void selectTopKBatch(const vector<vector<float>>& queries, const vector<double>& norms,
+                            const vector<double>& lo, const vector<double>& hi, int k,
+                            RedBlackTree<IndexKey, int>::RBTNode* rbtRoot,
+                            const VectorRecord* records, int dimension, StoragePrecision precision,
+                            vector<vector<int>>& results) {
+    const int QUERY_TILE = 16;
+    const int BLOCK_BYTES = 128 * 1024;
+    const int blockRows = max(1, BLOCK_BYTES / (int)(dimension * sizeof(float)));
+
+    int numQueries = (int)queries.size();
+    vector<int> candidates;
+    for (int first = 0; first < numQueries; first += QUERY_TILE) {
+        int last = min(first + QUERY_TILE, numQueries);
+
+        // One walk of the RBT for the union of the tile's bands
+        double tileLo = lo[first], tileHi = hi[first];
+        for (int q = first + 1; q < last; ++q) {
+            tileLo = min(tileLo, lo[q]);
+            tileHi = max(tileHi, hi[q]);
+        }
+        candidates.clear();
+        collectCandidates(rbtRoot, tileLo, tileHi, candidates);
+
+        vector<MetricScorer<M>> scorers;
+        vector<TopKHeap<M>> heaps;
+        scorers.reserve(last - first);
+        heaps.reserve(last - first);
+        for (int q = first; q < last; ++q) {
+            scorers.push_back(MetricScorer<M>(queries[q], dimension, precision, norms[q]));
+            heaps.push_back(TopKHeap<M>(k));
+        }
 
-    vector<VectorRecord*> records;
-    if (this->count > 0) {
-        records.reserve(this->count); // Optimize allocation
-        
-        inorder_getVector_helper(this->vectorStore->getRoot(), records);
+        for (size_t blockStart = 0; blockStart < candidates.size(); blockStart += blockRows) {
+            size_t blockEnd = min(candidates.size(), blockStart + (size_t)blockRows);
+            for (int q = first; q < last; ++q) {
+                const MetricScorer<M>& score = scorers[q - first];
+                TopKHeap<M>& heap = heaps[q - first];
+                for (size_t c = blockStart; c < blockEnd; ++c) {
+                    const VectorRecord& rec = records[candidates[c]];
+                    // rec.norm is the record's RBT key: same test as collectCandidates
+                    if (rec.norm < lo[q] || rec.norm > hi[q]) continue;
+                    heap.offer(score(rec), rec.id);
+                }
+            }
+        }
+
+        for (int q = first; q < last; ++q) {
+            TopKHeap<M>& heap = heaps[q - first];
+            results[q].resize(heap.size());
+            heap.drain(results[q].data());
+        }
     }
-    return records;
 }
 
+// Ids of the k closest records among the probed cells, closest first.
+// found = how many there were; the rest of the k entries are -1.
+int* VectorStore::searchIVF(const vector<float>& query, int k, Metric metric, int& found) {
+    if (this->ivf == nullptr || this->ivf->getMetric() != metric) {
+        throw invalid_metric(); // the cells were trained for one metric
+    }
+    if ((int)query.size() != this->dimension) {
+        throw invalid_argument("Query dimension does not match the store!");
+    }
+    vector<int> candidates;
+    int evaluated = 0;
+    this->ivf->probe(query.data(), this->ivfProbes, candidates, evaluated);
 
-
-
-// DISTANCE METRICS
-double VectorStore::cosineSimilarity(const vector<float>& v1, const vector<float>& v2) {
-    if (v1.size() != v2.size() || v1.empty()) {
-        return 0.0; // Or handle error
+    double nq = 0.0;
+    for (float val : query) nq += val * val;
+    nq = sqrt(nq);
+    PivotFilter pivots = pivotFilterFor(query);
+    int scored = 0;
+    int* hits = nullptr;
+    switch (metric) {
+        case EUCLIDEAN: hits = selectTopK<EUCLIDEAN>(query, nq, k, candidates, this->records, this->dimension, this->precision, pivots, scored); break;
+        case MANHATTAN: hits = selectTopK<MANHATTAN>(query, nq, k, candidates, this->records, this->dimension, this->precision, pivots, scored); break;
+        case COSINE:    hits = selectTopK<COSINE>(query, nq, k, candidates, this->records, this->dimension, this->precision, pivots, scored); break;
     }
+    this->lastDistanceEvaluations = evaluated + scored;
 
-    double dotProduct = 0.0;
-    double normA = 0.0;
-    double normB = 0.0;
+    found = (int)candidates.size() < k ? (int)candidates.size() : k;
+    int* ids = new int[k];
+    for (int i = 0; i < k; ++i) {
+        ids[i] = (i < found) ? hits[i] : -1;
+    }
+    delete[] hits;
+    return ids;
+}
 
-    for (size_t i = 0; i < v1.size(); ++i) {
-        dotProduct += v1[i] * v2[i];
-        normA += v1[i] * v1[i];
-        normB += v2[i] * v2[i];
+// Scores a record from its PQ code: the query's table is built once, after
+// which each record costs m lookups. Same scale as MetricScorer<M>.
+template <Metric M>
+class AdcScorer {
+public:
+    AdcScorer(const ProductQuantizer& pq, const vector<float>& query) : pq(pq), queryNorm(0.0) {
+        pq.buildTable(query.data(), M, table);
+        if constexpr (M == COSINE) {
+            for (float val : query) queryNorm += val * val;
+            queryNorm = sqrt(queryNorm);
+        }
     }
 
-    // Handle potential division by zero 
-    if (normA == 0.0 || normB == 0.0) {
-        return 0.0; 
+    double operator()(const VectorRecord& rec) const {
+        double total = pq.lookup(rec.slot, table.data());
+        if constexpr (M == EUCLIDEAN) return sqrt(total > 0.0 ? total : 0.0);
+        if constexpr (M == COSINE) {
+            // The dot product comes from the code, the norms are exact
+            if (queryNorm == 0.0 || rec.norm == 0.0) return 0.0;
+            return total / (queryNorm * rec.norm);
+        }
+        return total;
     }
 
-    return dotProduct / (sqrt(normA) * sqrt(normB));
-}
-// Manhattan Distance (L1)
-double VectorStore::l1Distance(const vector<float>& v1, const vector<float>& v2) {
-    if(v1.size() != v2.size() || v1.empty()) {
-        return 0.0; // Or handle error
+private:
+    const ProductQuantizer& pq;
+    vector<float> table;
+    double queryNorm;                   // cosine only
+};
+
+// Scores a record from its int8 codes with the code kernels. Same scale as
+// MetricScorer<M>.
+template <Metric M>
+class Int8Scorer {
+public:
+    Int8Scorer(const ScalarQuantizer& codes, const vector<float>& query, int dimension)
+        : codes(codes), dimension(dimension), bias(0.0), queryNorm(0.0) {
+        codes.prepareQuery(query.data(), M, operand, bias);
+        if constexpr (M == COSINE) {
+            for (float val : query) queryNorm += val * val;
+            queryNorm = sqrt(queryNorm);
+        }
     }
 
-    double sum = 0.0;
-    for (size_t i = 0; i < v1.size(); ++i) {
-        sum += fabs(v1[i] - v2[i]);
+    double operator()(const VectorRecord& rec) const {
+        const unsigned char* code = codes.codeOf(rec.slot);
+        if constexpr (M == EUCLIDEAN) {
+            // |u|^2 + |scale * code|^2 - 2 u . (scale * code)
+            double squared = bias + codes.rowTerm(rec.slot) - 2.0 * distanceKernels().codeDot(operand.data(), code, dimension);
+            return sqrt(squared > 0.0 ? squared : 0.0);
+        } else if constexpr (M == MANHATTAN) {
+            return distanceKernels().codeL1(operand.data(), codes.scales(), code, dimension);
+        } else {
+            // The dot product comes from the codes, the norms are exact
+            if (queryNorm == 0.0 || rec.norm == 0.0) return 0.0;
+            return (bias + distanceKernels().codeDot(operand.data(), code, dimension)) / (queryNorm * rec.norm);
+        }
     }
-    return sum;
-}
-// Euclidean Distance (L2)
-double VectorStore::l2Distance(const vector<float>& v1, const vector<float>& v2) {
-    if(v1.size() != v2.size() || v1.empty()) {
-        return 0.0; // Or handle error
+
+private:
+    const ScalarQuantizer& codes;
+    int dimension;
+    vector<float> operand;
+    double bias;                        // euclidean / cosine
+    double queryNorm;                   // cosine only
+};
+
+// Top-k over the quantized rows of every record, scored by `coded` (an
+// AdcScorer or Int8Scorer). Quantized scores tie often, so the max(k, depth)
+// best are kept under the total order of (score, slot), which makes the
+// result independent of how the slots are split across threads. With
+// depth > 0 those candidates are re-scored exactly and the k best kept.
+template <Metric M, class CodeScorer>
+static int* selectTopKCoded(const vector<float>& query, int k, int depth, const CodeScorer& coded,
+                            const VectorRecord* records, int slots, int dimension, StoragePrecision precision,
+                            int threads, int& evaluated) {
+    typedef priority_queue<pair<double, int>, vector<pair<double, int>>, FarthestOnTop<M>> Heap;
+    FarthestOnTop<M> ranksBefore; // true: first argument is closer (ties: lower slot)
+    int keep = depth > k ? depth : k;
+    auto offer = [&](Heap& heap, const pair<double, int>& item) {
+        if ((int)heap.size() < keep) heap.push(item);
+        else if (ranksBefore(item, heap.top())) {
+            heap.pop();
+            heap.push(item);
+        }
+    };
+
+    int parts = partitionCount(slots, threads);
+    vector<Heap> partBest(parts);
+    vector<int> partEvaluated(parts, 0);
+    parallelFor(0, parts, parts, [&](int part) {
+        int begin = (int)((long long)slots * part / parts);
+        int end = (int)((long long)slots * (part + 1) / parts);
+        for (int slot = begin; slot < end; ++slot) {
+            if (records[slot].id == -1) continue; // free slot
+            partEvaluated[part]++;
+            offer(partBest[part], {coded(records[slot]), slot});
+        }
+    });
+
+    Heap best;
+    evaluated = 0;
+    for (int part = 0; part < parts; ++part) {
+        evaluated += partEvaluated[part];
+        while (!partBest[part].empty()) {
+            offer(best, partBest[part].top());
+            partBest[part].pop();
+        }
     }
-    double sum = 0.0;
-    for (size_t i = 0; i < v1.size(); ++i) {
-        double diff = v1[i] - v2[i];
-        sum += diff * diff;
+    vector<int> ranked(best.size()); // slots, closest first
+    for (int i = (int)best.size() - 1; i >= 0; --i) {
+        ranked[i] = best.top().second;
+        best.pop();
     }
-    return sqrt(sum);
-}
 
-// ESTIMATING THRESHOLD D FROM k
-double VectorStore::estimateD_Linear(
-    const vector<float>& query, 
-    int k, 
-    double averageDistance, 
-    const vector<float>& reference, 
-    double c0_bias, 
-    double c1_slope) 
-{
-    // Formula: D = |dr - averageDistance| + c1_slope * averageDistance * k + c0_bias
-    double dr = l2Distance(query, reference);
-    double D = fabs(dr - averageDistance) + (c1_slope * averageDistance * k) + c0_bias;
-    return D;
-}
- 
-// NEAREST NEIGHBOR SEARCH
-int VectorStore::findNearest(const vector<float>& query, string metric){
-    if(this->empty()){
-        return -1; // Store is empty
+    int* top_ids = new int[k];
+    if (depth > 0) {
+        MetricScorer<M> score(query, dimension, precision);
+        TopKHeap<M> exact(k);
+        for (int slot : ranked) exact.offer(score(records[slot]), records[slot].id);
+        evaluated += (int)ranked.size();
+        exact.drain(top_ids);
+    } else {
+        for (int i = 0; i < k; ++i) top_ids[i] = records[ranked[i]].id;
     }
-    bool maximize;
-    double bestDistance;
+    return top_ids;
+}
 
-    if(metric == "cosine"){
-        maximize = true;
-        bestDistance = -2.0; // Cosine similarity ranges from -1 to 1
+// The k records closest by their PQ codes (re-ranked when rerankDepth > 0 and
+// the float rows are kept), closest first
+int* VectorStore::searchPQ(const vector<float>& query, int k, Metric metric) {
+    if (this->pq == nullptr) {
+        throw invalid_argument("Product quantization is not enabled!");
     }
-    else if(metric == "euclidean" || metric == "manhattan"){
-        maximize = false;
-        bestDistance = 1.0e30; // A large number
+    if ((int)query.size() != this->dimension) {
+        throw invalid_argument("Query dimension does not match the store!");
     }
-    else {
-        throw invalid_metric("Invalid metric");
+    int depth = this->rowsDropped ? 0 : this->rerankDepth; // nothing to re-rank against
+    int threads = threadCount();
+    int evaluated = 0;
+    int* top_ids = nullptr;
+    switch (metric) {
+        case EUCLIDEAN: top_ids = selectTopKCoded<EUCLIDEAN>(query, k, depth, AdcScorer<EUCLIDEAN>(*this->pq, query), this->records, this->arenaSize, this->dimension, this->precision, threads, evaluated); break;
+        case MANHATTAN: top_ids = selectTopKCoded<MANHATTAN>(query, k, depth, AdcScorer<MANHATTAN>(*this->pq, query), this->records, this->arenaSize, this->dimension, this->precision, threads, evaluated); break;
+        case COSINE:    top_ids = selectTopKCoded<COSINE>(query, k, depth, AdcScorer<COSINE>(*this->pq, query), this->records, this->arenaSize, this->dimension, this->precision, threads, evaluated); break;
+        default: throw invalid_metric();
     }
-    
-    int bestId = -1;
-
-    // use AVL to traverse
-    queue<AVLTree<double, VectorRecord>::AVLNode*> q;
-    q.push(this->vectorStore->root);
-
-    while (!q.empty()) {
-        AVLTree<double, VectorRecord>::AVLNode* node = q.front();
-        q.pop();
-
-        if (node == nullptr) continue;
-
-        VectorRecord& currentRecord = node->data;
-        double currentDistance;
-
-        // Calculate the score based on the chosen metric
-        if (metric == "euclidean") {
-            currentDistance = l2Distance(query, *(currentRecord.vector));
-        } 
-        else if (metric == "manhattan") {
-            currentDistance = l1Distance(query, *(currentRecord.vector));
-        } 
-        else if(metric == "cosine"){ 
-            currentDistance = cosineSimilarity(query, *(currentRecord.vector));
-        }
+    this->lastDistanceEvaluations = evaluated;
+    return top_ids;
+}
 
-        // Update the best-scoring vector
-        if (maximize) {
-            // For cosine, we want the MAXIMUM score
-            if (currentDistance > bestDistance) {
-                bestDistance = currentDistance;
-                bestId = currentRecord.id;
-            }
-        } 
-        else {
-            // For distance, we want the MINIMUM score
-            if (currentDistance < bestDistance) {
-                bestDistance = currentDistance;
-                bestId = currentRecord.id;
-            }
-        }
-        
-        // Continue traversal
-        if (node->pLeft) q.push(node->pLeft);
-        if (node->pRight) q.push(node->pRight);
+// The k records closest by their int8 codes (re-ranked when rerankDepth > 0 and
+// the float rows are kept), closest first
+int* VectorStore::searchInt8(const vector<float>& query, int k, Metric metric) {
+    if (this->int8Codes == nullptr) {
+        throw invalid_argument("Int8 quantization is not enabled!");
     }
-    
-    return bestId;
+    if ((int)query.size() != this->dimension) {
+        throw invalid_argument("Query dimension does not match the store!");
+    }
+    const ScalarQuantizer& codes = *this->int8Codes;
+    int depth = this->rowsDropped ? 0 : this->rerankDepth; // nothing to re-rank against
+    int threads = threadCount();
+    int evaluated = 0;
+    int* top_ids = nullptr;
+    switch (metric) {
+        case EUCLIDEAN: top_ids = selectTopKCoded<EUCLIDEAN>(query, k, depth, Int8Scorer<EUCLIDEAN>(codes, query, this->dimension), this->records, this->arenaSize, this->dimension, this->precision, threads, evaluated); break;
+        case MANHATTAN: top_ids = selectTopKCoded<MANHATTAN>(query, k, depth, Int8Scorer<MANHATTAN>(codes, query, this->dimension), this->records, this->arenaSize, this->dimension, this->precision, threads, evaluated); break;
+        case COSINE:    top_ids = selectTopKCoded<COSINE>(query, k, depth, Int8Scorer<COSINE>(codes, query, this->dimension), this->records, this->arenaSize, this->dimension, this->precision, threads, evaluated); break;
+        default: throw invalid_metric();
+    }
+    this->lastDistanceEvaluations = evaluated;
+    return top_ids;
 }
 
+// Scores a record from its SimHash signature: cos(pi * h / bits) for Hamming
+// distance h, the signatures' estimate of the cosine similarity
+class SimHashScorer {
+public:
+    SimHashScorer(const SimHasher& hasher, const vector<float>& query)
+        : hasher(hasher), signature(hasher.words()), estimate(hasher.bitCount() + 1) {
+        hasher.sign(query.data(), signature.data());
+        const double pi = 3.141592653589793;
+        for (int h = 0; h <= hasher.bitCount(); ++h) estimate[h] = cos(pi * h / hasher.bitCount());
+    }
 
-// Helper function to collect candidates within [minNorm, maxNorm]
-static void collectCandidates(
-    RedBlackTree<double, VectorRecord>::RBTNode* node,
-    double minNorm, double maxNorm,
-    vector<VectorRecord*>& candidates)
-{
-    if (node == nullptr) {
-        return;
+    double operator()(const VectorRecord& rec) const {
+        return estimate[distanceKernels().hamming(signature.data(), hasher.signatureOf(rec.slot), hasher.words())];
     }
-    //check left
-    if (node->key > minNorm) {
-        collectCandidates(node->left, minNorm, maxNorm, candidates);
+
+private:
+    const SimHasher& hasher;
+    vector<unsigned long long> signature;
+    vector<double> estimate;            // by Hamming distance
+};
+
+// The k records closest by cosine among the best simHashCandidates by
+// signature (or by signature alone when that is 0), closest first
+int* VectorStore::searchSimHash(const vector<float>& query, int k, Metric metric) {
+    if (this->simHash == nullptr) {
+        throw invalid_argument("SimHash signatures are not enabled!");
     }
-    // if the current node is in range, add it.
-    if (node->key >= minNorm && node->key <= maxNorm) {
-        candidates.push_back(&(node->data));
+    if (metric != COSINE) {
+        throw invalid_metric(); // signatures only estimate angles
     }
-    //check right
-    if (node->key < maxNorm) {
-        collectCandidates(node->right, minNorm, maxNorm, candidates);
+    if ((int)query.size() != this->dimension) {
+        throw invalid_argument("Query dimension does not match the store!");
     }
+    int evaluated = 0;
+    int* top_ids = selectTopKCoded<COSINE>(query, k, this->simHashCandidates, SimHashScorer(*this->simHash, query),
+                                           this->records, this->arenaSize, this->dimension, this->precision,
+                                           threadCount(), evaluated);
+    this->lastDistanceEvaluations = evaluated;
+    return top_ids;
 }
-int* VectorStore:: topKNearest(const vector<float>& query, int k, string metric) {
+
+int* VectorStore::topKNearest(const vector<float>& query, int k, string metric) {
     if (k <= 0 || k > this->count) {
         throw invalid_k_value();
     }
-    
-    bool maximize; // true for cosine, false for distances
+    return topKNearest(query, k, parseMetric(metric));
+}
 
-    if (metric == "cosine") {
-        maximize = true;
-    } 
-    else if (metric == "euclidean" || metric == "manhattan") {
-        maximize = false;
-    } 
-    else {
+int* VectorStore::topKNearest(const vector<float>& query, int k, Metric metric, SearchMode mode) {
+    if (k <= 0 || k > this->count) {
+        throw invalid_k_value();
+    }
+    if (metric != EUCLIDEAN && metric != MANHATTAN && metric != COSINE) {
         throw invalid_metric();
     }
+
+    if (mode == HNSW || mode == IVF || mode == PQ || mode == INT8 || mode == SIMHASH) {
+        int found = 0;
+        int* top_ids = (mode == HNSW) ? searchHNSW(query, k, metric, found)
+                     : (mode == IVF)  ? searchIVF(query, k, metric, found)
+                     : (mode == PQ)   ? searchPQ(query, k, metric)
+                     : (mode == INT8) ? searchInt8(query, k, metric)
+                     : searchSimHash(query, k, metric);
+        return top_ids;
+    }
+    requireFloatRows();
+
     // 1. Compute query norm 
     double nq = 0.0;
     for (float val : query) {
@@ -1664,11 +5043,31 @@ int* VectorStore:: topKNearest(const vector<float>& query, int k, string metric)
     // 2. Estimate radius D 
     double D = estimateD_Linear(query, k, this->averageDistance, *(this->referenceVector));
 
-    // 3. Filter using Red Black Tree
-    vector<VectorRecord*> candidates;
     // Get the RBT root
-    RedBlackTree<double, VectorRecord>::RBTNode* rbtRoot = this->normIndex->root;
-    
+    RedBlackTree<IndexKey, int>::RBTNode* rbtRoot = this->normIndex->root;
+
+    PivotFilter pivots = pivotFilterFor(query);
+    int evaluated = 0;
+
+    if (mode == EXACT) {
+        int* top_ids = nullptr;
+        switch (metric) {
+            case EUCLIDEAN: top_ids = selectTopKExact<EUCLIDEAN>(query, nq, D, k, this->count, rbtRoot, this->records, this->dimension, this->precision, pivots, evaluated); break;
+            case MANHATTAN: top_ids = selectTopKExact<MANHATTAN>(query, nq, D, k, this->count, rbtRoot, this->records, this->dimension, this->precision, pivots, evaluated); break;
+            case COSINE: {
+                // The norm gives no bound on cosine similarity: score everything
+                vector<int> candidates;
+                collectCandidates(rbtRoot, -1.0, 1.0e300, candidates);
+                top_ids = selectTopK<COSINE>(query, nq, k, candidates, this->records, this->dimension, this->precision, pivots, evaluated);
+                break;
+            }
+        }
+        this->lastDistanceEvaluations = evaluated;
+        return top_ids;
+    }
+
+    // 3. Filter using Red Black Tree
+    vector<int> candidates; // slots
     collectCandidates(rbtRoot, nq - D, nq + D, candidates);
 
     int m = candidates.size();
@@ -1679,60 +5078,50 @@ int* VectorStore:: topKNearest(const vector<float>& query, int k, string metric)
         return new int[0]; // no candidate -> return empty dynamic array
     }
 
-    // cosine -> use a min-heap to keep the k LARGEST scores.
-    // distance -> use max-heap to keep the k SMALLEST distances.
-    
-    if (maximize) { // Cosine (use min-heap)
-        priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> min_heap;
+    int* top_ids = nullptr;
+    switch (metric) {
+        case EUCLIDEAN: top_ids = selectTopK<EUCLIDEAN>(query, nq, k, candidates, this->records, this->dimension, this->precision, pivots, evaluated); break;
+        case MANHATTAN: top_ids = selectTopK<MANHATTAN>(query, nq, k, candidates, this->records, this->dimension, this->precision, pivots, evaluated); break;
+        case COSINE:    top_ids = selectTopK<COSINE>(query, nq, k, candidates, this->records, this->dimension, this->precision, pivots, evaluated); break;
+    }
+    this->lastDistanceEvaluations = evaluated;
+    return top_ids;
+}
 
-        for (VectorRecord* rec : candidates) {
-            double score = cosineSimilarity(query, *(rec->vector));
-            
-            if (min_heap.size() < (size_t)k) {
-                min_heap.push({score, rec->id});
-            } else if (score > min_heap.top().first) {
-                min_heap.pop();
-                min_heap.push({score, rec->id});
-            }
-        }
-        int result_size = min_heap.size();
-        int* top_ids = new int[result_size];
-        // Pop from min-heap -> descending order of score (closest first)
-        for (int i = result_size - 1; i >= 0; i--) {
-            top_ids[i] = min_heap.top().second; // {score, id}
-            min_heap.pop();
+vector<vector<int>> VectorStore::topKNearestBatch(const vector<vector<float>>& queries, int k, Metric metric) {
+    if (k <= 0 || k > this->count) {
+        throw invalid_k_value();
+    }
+    requireFloatRows();
+    if (metric != EUCLIDEAN && metric != MANHATTAN && metric != COSINE) {
+        throw invalid_metric();
+    }
+
+    // Per-query norm and candidate band, exactly as topKNearest computes them
+    int numQueries = (int)queries.size();
+    vector<double> norms(numQueries), lo(numQueries), hi(numQueries);
+    for (int q = 0; q < numQueries; ++q) {
+        double nq = 0.0;
+        for (float val : queries[q]) {
+            nq += val * val;
         }
-        return top_ids;
+        nq = sqrt(nq);
+        double D = estimateD_Linear(queries[q], k, this->averageDistance, *(this->referenceVector));
+        norms[q] = nq;
+        lo[q] = nq - D;
+        hi[q] = nq + D;
     }
-    else{   // Euclidean or Manhattan (use max-heap)
-        priority_queue<pair<double, int>> max_heap; // {distance, id}
-        for(VectorRecord* rec: candidates){
-            double distance;
 
-            if(metric == "euclidean"){
-                distance = l2Distance(query, *(rec->vector));
-            }
-            else{ //manhattan
-                distance = l1Distance(query, *(rec->vector));
-            }
+    vector<vector<int>> results(numQueries);
+    if (numQueries == 0) return results;
 
-            if(max_heap.size() < (size_t)k){
-                max_heap.push({distance, rec->id});
-            }
-            else if(distance < max_heap.top().first){
-                max_heap.pop();
-                max_heap.push({distance, rec->id});
-            }
-        }
-        int result_size = max_heap.size();
-        int* top_ids = new int[result_size];
-        // Pop from max-heap -> descending order of distance
-        for(int i = result_size - 1; i >= 0; i--){
-            top_ids[i] = max_heap.top().second; // <distance, id>
-            max_heap.pop();
-        }
-        return top_ids;
+    RedBlackTree<IndexKey, int>::RBTNode* rbtRoot = this->normIndex->root;
+    switch (metric) {
+        case EUCLIDEAN: selectTopKBatch<EUCLIDEAN>(queries, norms, lo, hi, k, rbtRoot, this->records, this->dimension, this->precision, results); break;
+        case MANHATTAN: selectTopKBatch<MANHATTAN>(queries, norms, lo, hi, k, rbtRoot, this->records, this->dimension, this->precision, results); break;
+        case COSINE:    selectTopKBatch<COSINE>(queries, norms, lo, hi, k, rbtRoot, this->records, this->dimension, this->precision, results); break;
     }
+    return results;
 }
 
 // OVERLOADED FUNCTIONS
@@ -1743,46 +5132,20 @@ double VectorStore::l1Distance(const vector<float>& v1, const vector<float>& v2)
     if(v1.size() != v2.size() || v1.empty()) {
         return 0.0;
     }
-
-    double sum = 0.0;
-    for (size_t i = 0; i < v1.size(); ++i) {
-        sum += fabs(v1[i] - v2[i]);
-    }
-    return sum;
+    return l1Kernel(v1.data(), v2.data(), (int)v1.size());
 }
 
 double VectorStore::l2Distance(const vector<float>& v1, const vector<float>& v2) const {
     if(v1.size() != v2.size() || v1.empty()) {
         return 0.0;
     }
-    double sum = 0.0;
-    for (size_t i = 0; i < v1.size(); ++i) {
-        double diff = v1[i] - v2[i];
-        sum += diff * diff;
-    }
-    return sqrt(sum);
+    return l2Kernel(v1.data(), v2.data(), (int)v1.size());
 }
 double VectorStore::cosineSimilarity(const vector<float>& v1, const vector<float>& v2) const {
     if (v1.size() != v2.size() || v1.empty()) {
         return 0.0; // Or handle error
     }
-
-    double dotProduct = 0.0;
-    double normA = 0.0;
-    double normB = 0.0;
-
-    for (size_t i = 0; i < v1.size(); ++i) {
-        dotProduct += v1[i] * v2[i];
-        normA += v1[i] * v1[i];
-        normB += v2[i] * v2[i];
-    }
-
-    // Handle potential division by zero 
-    if (normA == 0.0 || normB == 0.0) {
-        return 0.0; 
-    }
-
-    return dotProduct / (sqrt(normA) * sqrt(normB));
+    return cosineKernel(v1.data(), v2.data(), (int)v1.size());
 }
 // RANGE QUERY
 int* VectorStore::rangeQueryFromRoot(double minDist, double maxDist) const {
@@ -1795,12 +5158,13 @@ int* VectorStore::rangeQueryFromRoot(double minDist, double maxDist) const {
         return new int[0];
     }
 
-    // Recursive helper that prunes branches by key (node->key is distanceFromReference)
-    auto collectInRangeHelper = [&](AVLTree<double, VectorRecord>::AVLNode* node, auto&& self) -> void {
+    // Recursive helper that prunes branches by key (node->key.value is distanceFromReference).
+    // Equal distances may sit on either side of a node, so boundaries are inclusive.
+    auto collectInRangeHelper = [&](AVLTree<IndexKey, int>::AVLNode* node, auto&& self) -> void {
         if (!node) return;
-        if (node->key > minDist) self(node->pLeft, self);
-        if (node->key >= minDist && node->key <= maxDist) matchingIds.push_back(node->data.id);
-        if (node->key < maxDist) self(node->pRight, self);
+        if (node->key.value >= minDist) self(node->pLeft, self);
+        if (node->key.value >= minDist && node->key.value <= maxDist) matchingIds.push_back(this->records[node->data].id);
+        if (node->key.value <= maxDist) self(node->pRight, self);
     };
 
     collectInRangeHelper(this->vectorStore->getRoot(), collectInRangeHelper);
@@ -1809,27 +5173,189 @@ int* VectorStore::rangeQueryFromRoot(double minDist, double maxDist) const {
     for (size_t i = 0; i < matchingIds.size(); ++i) idArray[i] = matchingIds[i];
     return idArray;
 }
-int* VectorStore::rangeQuery(const vector<float>& query, double radius, string metric) const {
-    // Validate metric and compute score for every vector (O(n * d)). Use
-    // distanceByMetric helper for consistency and throw invalid_metric on bad input.
-    if (!(metric == "cosine" || metric == "euclidean" || metric == "manhattan")) {
-        throw invalid_metric();
+// In-order walk over the nodes whose in-order rank lies in [lo, hi);
+// `offset` is the rank of the leftmost node under `node`. Subtree sizes let
+// the walk skip everything outside the range.
+// Subtrees for which skip(node) holds are not entered at all.
+template <class Skip, class Visit>
+static void visitRankRange(AVLTree<IndexKey, int>::AVLNode* node, int lo, int hi, int offset,
+                           const Skip& skip, const Visit& visit) {
+    if (!node || hi <= offset || offset + node->size <= lo || skip(node)) return;
+    int rank = offset + (node->pLeft ? node->pLeft->size : 0);
+    visitRankRange(node->pLeft, lo, hi, offset, skip, visit);
+    if (rank >= lo && rank < hi) visit(node);
+    visitRankRange(node->pRight, lo, hi, rank + 1, skip, visit);
+}
+
+static bool skipNothing(AVLTree<IndexKey, int>::AVLNode*) {
+    return false;
+}
+
+// Do the subtree bounds (first dims dimensions) leave no room for a point
+// strictly inside (minBound, maxBound)?
+static bool boundsMissBox(const float* low, int dims, const float* minBound, const float* maxBound) {
+    const float* high = low + dims;
+    for (int i = 0; i < dims; ++i) {
+        if (high[i] <= minBound[i] || low[i] >= maxBound[i]) return true;
     }
+    return false;
+}
 
-    bool maximize = (metric == "cosine");
+// Lower bound on the euclidean / manhattan distance from query to any row of
+// the subtree: its distance to the subtree bounds over the first dims dimensions
+template <Metric M>
+static double boundsLowerBound(const float* low, int dims, const float* query) {
+    const float* high = low + dims;
+    double total = 0.0;
+    for (int i = 0; i < dims; ++i) {
+        double gap = query[i] < low[i] ? low[i] - query[i] : (query[i] > high[i] ? query[i] - high[i] : 0.0);
+        total += (M == EUCLIDEAN) ? gap * gap : gap;
+    }
+    return (M == EUCLIDEAN) ? sqrt(total) : total;
+}
 
-    vector<int> matchingIds;
-    // traverse entire AVL (O(n)). Implement recursion with a local Y-combinator style helper
-    auto visitAllHelper = [&](AVLTree<double, VectorRecord>::AVLNode* node, auto&& self) -> void {
-        if (!node) return;
-        self(node->pLeft, self);
-        double score = distanceByMetric(query, *(node->data.vector), metric);
-        bool inRange = maximize ? (score >= radius) : (score <= radius);
-        if (inRange) matchingIds.push_back(node->data.id);
-        self(node->pRight, self);
+// Ids of the records with in-order rank in [first, last) for which
+// matches(record, counter) holds, in AVL in-order. The ranks are cut into
+// contiguous ranges walked on separate threads; the per-range lists are
+// concatenated in rank order, so the result is the same as one sequential
+// walk. Each range has its own counter for matches to bump (e.g. distances
+// computed); the sum is returned. Subtrees for which skip(node) holds are
+// passed over without calling matches.
+template <class Skip, class Match>
+static int collectMatchingInorder(AVLTree<IndexKey, int>::AVLNode* root, int first, int last,
+                                  const VectorRecord* records, int threads, const Skip& skip,
+                                  const Match& matches, vector<int>& matchingIds) {
+    if (!root || first >= last) return 0;
+    int total = last - first;
+    int parts = partitionCount(total, threads);
+    vector<vector<int>> partIds(parts);
+    vector<int> partCounters(parts, 0);
+    parallelFor(0, parts, parts, [&](int part) {
+        int lo = first + (int)((long long)total * part / parts);
+        int hi = first + (int)((long long)total * (part + 1) / parts);
+        visitRankRange(root, lo, hi, 0, skip, [&](AVLTree<IndexKey, int>::AVLNode* node) {
+            const VectorRecord& rec = records[node->data];
+            if (matches(rec, partCounters[part])) partIds[part].push_back(rec.id);
+        });
+    });
+    int counted = 0;
+    for (int part = 0; part < parts; ++part) {
+        matchingIds.insert(matchingIds.end(), partIds[part].begin(), partIds[part].end());
+        counted += partCounters[part];
+    }
+    return counted;
+}
+
+// Every record of AVL rank [first, last) whose score lies within the radius, in AVL (distance) order.
+// Records the pivots place beyond the radius, and subtrees whose bounds over
+// the first boundDims dimensions do, are skipped without an exact distance.
+template <Metric M>
+static void collectWithinRadius(const AVLTree<IndexKey, int>& tree, int first, int last,
+                                const vector<float>& query, double radius,
+                                const VectorRecord* records, int dimension, StoragePrecision precision,
+                                const PivotFilter& pivots, int boundDims, int threads,
+                                vector<int>& matchingIds, int& evaluated) {
+    MetricScorer<M> score(query, dimension, precision);
+    auto skip = [&](AVLTree<IndexKey, int>::AVLNode* node) {
+        if constexpr (M != COSINE) {
+            if (boundDims > 0) {
+                double gap = boundsLowerBound<M>(tree.boundsOf(node), boundDims, query.data());
+                // Slack for float rounding in the kernels; the exact test still decides
+                return gap > radius + roundingSlack(gap + fabs(radius));
+            }
+        }
+        return false;
     };
+    evaluated = collectMatchingInorder(tree.getRoot(), first, last, records, threads, skip,
+        [&](const VectorRecord& rec, int& partEvaluated) {
+            if constexpr (M != COSINE) {
+                if (pivots.active() && pivots.lowerBound(rec.slot) > radius) return false;
+            }
+            partEvaluated++;
+            return MetricScorer<M>::within(score(rec), radius);
+        }, matchingIds);
+}
 
-    visitAllHelper(this->vectorStore->getRoot(), visitAllHelper);
+// Range query over quantized rows scored by `coded`; with rerank, each code
+// match is confirmed against the full row (false positives go, misses stay missed)
+template <Metric M, class CodeScorer>
+static void collectWithinRadiusCoded(AVLTree<IndexKey, int>::AVLNode* root, int first, int last,
+                                     const vector<float>& query, double radius, const CodeScorer& coded, bool rerank,
+                                     const VectorRecord* records, int dimension, StoragePrecision precision,
+                                     int threads, vector<int>& matchingIds, int& evaluated) {
+    MetricScorer<M> score(query, dimension, precision);
+    evaluated = collectMatchingInorder(root, first, last, records, threads, skipNothing,
+        [&](const VectorRecord& rec, int& partEvaluated) {
+            partEvaluated++;
+            if (!MetricScorer<M>::within(coded(rec), radius)) return false;
+            if (!rerank) return true;
+            partEvaluated++;
+            return MetricScorer<M>::within(score(rec), radius);
+        }, matchingIds);
+}
+
+int* VectorStore::rangeQuery(const vector<float>& query, double radius, string metric) const {
+    return rangeQuery(query, radius, parseMetric(metric));
+}
+
+int* VectorStore::rangeQuery(const vector<float>& query, double radius, Metric metric, SearchMode mode) const {
+    vector<int> matchingIds;
+    if (mode == PQ && this->pq == nullptr) {
+        throw invalid_argument("Product quantization is not enabled!");
+    }
+    if (mode == INT8 && this->int8Codes == nullptr) {
+        throw invalid_argument("Int8 quantization is not enabled!");
+    }
+    if ((mode == PQ || mode == INT8) && (int)query.size() != this->dimension) {
+        throw invalid_argument("Query dimension does not match the store!");
+    }
+    if (mode != PQ && mode != INT8) requireFloatRows();
+    AVLTree<IndexKey, int>::AVLNode* root = this->vectorStore->getRoot();
+    int threads = threadCount();
+
+    // By default every record is scored (O(n * d)). For euclidean the triangle
+    // inequality |d(q, ref) - d(x, ref)| <= d(q, x) means only records whose
+    // AVL key lies in [d(q, ref) - r, d(q, ref) + r] can qualify, so only that
+    // rank range is scored: O(log n + m * d).
+    int first = 0, last = this->count;
+    if (metric == EUCLIDEAN && (int)query.size() == this->dimension && !query.empty()) {
+        double dq = l2Kernel(query.data(), this->referenceVector->data(), this->dimension);
+        // Slack for float rounding in the kernels; the exact test still decides
+        double slack = roundingSlack(dq + fabs(radius));
+        first = this->vectorStore->rank(IndexKey(dq - radius - slack, -1));
+        last = this->vectorStore->rank(IndexKey(dq + radius + slack, this->nextId)); // every id < nextId
+        if (last < first) last = first;
+    }
+
+    int evaluated = 0;
+    bool rerank = this->rerankDepth > 0 && !this->rowsDropped;
+    // The annulus still holds for the quantized modes: it only rules out records beyond the radius
+    if (mode == PQ) {
+        switch (metric) {
+            case EUCLIDEAN: collectWithinRadiusCoded<EUCLIDEAN>(root, first, last, query, radius, AdcScorer<EUCLIDEAN>(*this->pq, query), rerank, this->records, this->dimension, this->precision, threads, matchingIds, evaluated); break;
+            case MANHATTAN: collectWithinRadiusCoded<MANHATTAN>(root, first, last, query, radius, AdcScorer<MANHATTAN>(*this->pq, query), rerank, this->records, this->dimension, this->precision, threads, matchingIds, evaluated); break;
+            case COSINE:    collectWithinRadiusCoded<COSINE>(root, first, last, query, radius, AdcScorer<COSINE>(*this->pq, query), rerank, this->records, this->dimension, this->precision, threads, matchingIds, evaluated); break;
+            default: throw invalid_metric();
+        }
+    } else if (mode == INT8) {
+        const ScalarQuantizer& codes = *this->int8Codes;
+        switch (metric) {
+            case EUCLIDEAN: collectWithinRadiusCoded<EUCLIDEAN>(root, first, last, query, radius, Int8Scorer<EUCLIDEAN>(codes, query, this->dimension), rerank, this->records, this->dimension, this->precision, threads, matchingIds, evaluated); break;
+            case MANHATTAN: collectWithinRadiusCoded<MANHATTAN>(root, first, last, query, radius, Int8Scorer<MANHATTAN>(codes, query, this->dimension), rerank, this->records, this->dimension, this->precision, threads, matchingIds, evaluated); break;
+            case COSINE:    collectWithinRadiusCoded<COSINE>(root, first, last, query, radius, Int8Scorer<COSINE>(codes, query, this->dimension), rerank, this->records, this->dimension, this->precision, threads, matchingIds, evaluated); break;
+            default: throw invalid_metric();
+        }
+    } else {
+        PivotFilter pivots = pivotFilterFor(query);
+        int boundDims = ((int)query.size() == this->dimension) ? this->vectorStore->getBoundDims() : 0;
+        switch (metric) {
+            case EUCLIDEAN: collectWithinRadius<EUCLIDEAN>(*this->vectorStore, first, last, query, radius, this->records, this->dimension, this->precision, pivots, boundDims, threads, matchingIds, evaluated); break;
+            case MANHATTAN: collectWithinRadius<MANHATTAN>(*this->vectorStore, first, last, query, radius, this->records, this->dimension, this->precision, pivots, boundDims, threads, matchingIds, evaluated); break;
+            case COSINE:    collectWithinRadius<COSINE>(*this->vectorStore, first, last, query, radius, this->records, this->dimension, this->precision, pivots, boundDims, threads, matchingIds, evaluated); break;
+            default: throw invalid_metric();
+        }
+    }
+    this->lastDistanceEvaluations = evaluated;
 
     int* idArray = new int[matchingIds.size()];
     for (size_t i = 0; i < matchingIds.size(); ++i) idArray[i] = matchingIds[i];
@@ -1837,6 +5363,7 @@ int* VectorStore::rangeQuery(const vector<float>& query, double radius, string m
 }
 
 int* VectorStore::boundingBoxQuery(const vector<float>& minBound, const vector<float>& maxBound) const {
+    requireFloatRows();
     vector<int> matchingIds;
 
     // Basic validation of bound dimensions
@@ -1844,21 +5371,36 @@ int* VectorStore::boundingBoxQuery(const vector<float>& minBound, const vector<f
         return new int[0];
     }
 
-    // Traverse all nodes (O(n)) and test bounding-box inclusion using local recursive helper
-    auto visitBoxHelper = [&](AVLTree<double, VectorRecord>::AVLNode* node, auto&& self) -> void {
-        if (!node) return;
-        self(node->pLeft, self);
-        VectorRecord& currentRecord = node->data;
-        vector<float>* vec = currentRecord.vector;
-        bool isInside = true;
-        for (int i = 0; i < this->dimension; ++i) {
-            if ((*vec)[i] <= minBound[i] || (*vec)[i] >= maxBound[i]) { isInside = false; break; }
-        }
-        if (isInside) matchingIds.push_back(currentRecord.id);
-        self(node->pRight, self);
-    };
-
-    visitBoxHelper(this->vectorStore->getRoot(), visitBoxHelper);
+    if (this->kdTree) {
+        // Only the leaves overlapping the box are tested; the matches are
+        // then put back into AVL order by their keys
+        vector<int> slots;
+        int evaluated = 0;
+        this->kdTree->query(this->arena, minBound.data(), maxBound.data(), slots, evaluated);
+        vector<IndexKey> keys;
+        keys.reserve(slots.size());
+        for (int slot : slots) keys.push_back(IndexKey(this->records[slot].distanceFromReference, this->records[slot].id));
+        sortHandles(keys, slots);
+        for (int slot : slots) matchingIds.push_back(this->records[slot].id);
+        this->lastDistanceEvaluations = evaluated;
+    } else {
+        // Test every node (O(n)) for bounding-box inclusion, in AVL order,
+        // minus the subtrees whose bounds lie outside the box
+        int boundDims = this->vectorStore->getBoundDims();
+        auto skip = [&](AVLTree<IndexKey, int>::AVLNode* node) {
+            return boundDims > 0 && boundsMissBox(this->vectorStore->boundsOf(node), boundDims, minBound.data(), maxBound.data());
+        };
+        this->lastDistanceEvaluations = collectMatchingInorder(this->vectorStore->getRoot(), 0, this->count,
+                                                               this->records, threadCount(), skip,
+            [&](const VectorRecord& currentRecord, int& partEvaluated) {
+                const float* vec = currentRecord.vector;
+                partEvaluated++;
+                for (int i = 0; i < this->dimension; ++i) {
+                    if (vec[i] <= minBound[i] || vec[i] >= maxBound[i]) return false;
+                }
+                return true;
+            }, matchingIds);
+    }
 
     int* idArray = new int[matchingIds.size()];
     for (size_t i = 0; i < matchingIds.size(); ++i) idArray[i] = matchingIds[i];
@@ -1866,13 +5408,13 @@ int* VectorStore::boundingBoxQuery(const vector<float>& minBound, const vector<f
 }
 
 // ADVANCED UTILS METHODS
-static double getMaxHelper(AVLTree<double, VectorRecord>::AVLNode* node) {
+static double getMaxHelper(AVLTree<IndexKey, int>::AVLNode* node) {
     if (!node) return 0.0;
 
     while (node->pRight) {
         node = node->pRight;
     }
-    return node->key;
+    return node->key.value;
 }
 
 double VectorStore::getMaxDistance() const {
@@ -1887,9 +5429,9 @@ double VectorStore::getMinDistance() const {
         return 0.0;
     }
     //already have findMin()
-    AVLTree<double, VectorRecord>::AVLNode* minNode = this->vectorStore->findMin(this->vectorStore->getRoot());
+    AVLTree<IndexKey, int>::AVLNode* minNode = this->vectorStore->findMin(this->vectorStore->getRoot());
     
-    return minNode->key;
+    return minNode->key.value;
 }
 
 VectorRecord VectorStore::computeCentroid(const vector<VectorRecord*>& records) const {
@@ -1897,6 +5439,7 @@ VectorRecord VectorStore::computeCentroid(const vector<VectorRecord*>& records)
     if (m == 0) {
         return VectorRecord(); // Return default-constructed record
     }
+    requireFloatRows();
 
     int d = this->dimension; // d is dimensionality
     vector<double> sumVector(d, 0.0); // Use double for precision
@@ -1904,21 +5447,20 @@ VectorRecord VectorStore::computeCentroid(const vector<VectorRecord*>& records)
     // Sum all vectors
     for (VectorRecord* rec : records) {
         for (int i = 0; i < d; i++) {
-            sumVector[i] += (*(rec->vector))[i];
+            sumVector[i] += rec->vector[i];
         }
     }
 
-    // Create the new centroid vector
-    vector<float>* centroidVec = new vector<float>();
-    centroidVec->reserve(d);
+    // Create the new centroid vector (not part of the arena: the caller owns it, delete[])
+    float* centroidVec = new float[d];
 
     // Average the sums
     for (int i = 0; i < d; ++i) {
-        centroidVec->push_back(static_cast<float>(sumVector[i] / m));
+        centroidVec[i] = static_cast<float>(sumVector[i] / m);
     }
 
     // Return a new VectorRecord for the centroid
-    return VectorRecord(-1, "centroid", centroidVec, 0.0);
+    return VectorRecord(-1, "centroid", -1, RowPointer(centroidVec, d), 0.0);
 }
 
 VectorRecord* VectorStore::findVectorNearestToDistance(double targetDistance) const {
@@ -1926,115 +5468,58 @@ VectorRecord* VectorStore::findVectorNearestToDistance(double targetDistance) co
         return nullptr;
     }
 
-    VectorRecord* bestRecord = nullptr;
+    // The AVL is ordered by distance: the closest key lies on the search path
+    // of targetDistance, so one descent (O(log n)) is enough
+    AVLTree<IndexKey, int>::AVLNode* node = this->vectorStore->getRoot();
+    int bestSlot = -1;
     double minDiff = -1.0; // -1 = not set
 
-    queue<AVLTree<double, VectorRecord>::AVLNode*> q;
-    q.push(this->vectorStore->getRoot());
-
-    while (!q.empty()) {
-        AVLTree<double, VectorRecord>::AVLNode* node = q.front();
-        q.pop();
-        if (node == nullptr) continue;
-
-        double currentDiff = fabs(node->data.distanceFromReference - targetDistance);
+    while (node != nullptr) {
+        double currentDiff = fabs(node->key.value - targetDistance);
 
-        if (bestRecord == nullptr || currentDiff < minDiff) {
+        if (bestSlot == -1 || currentDiff < minDiff) {
             minDiff = currentDiff;
-            bestRecord = &(node->data);
+            bestSlot = node->data;
         }
 
-        if (node->pLeft) q.push(node->pLeft);
-        if (node->pRight) q.push(node->pRight);
+        node = (targetDistance < node->key.value) ? node->pLeft : node->pRight;
     }
-    return bestRecord;
+    return &this->records[bestSlot];
 }
 
 // PRIVATE HELPER IMPLEMENTATIONS
 
-double VectorStore::distanceByMetric(const vector<float>& a, const vector<float>& b, const string& metric) const 
+double VectorStore::distanceByMetric(const vector<float>& a, const float* row, Metric metric) const 
 {
-    if (metric == "euclidean") {
-        return l2Distance(a, b);
-    } 
-    else if (metric == "manhattan") {
-        return l1Distance(a, b);
-    } 
-    else if (metric == "cosine") {
-        return cosineSimilarity(a, b);
+    switch (metric) {
+        case EUCLIDEAN: return l2ToRow(a, row);
+        case MANHATTAN: return l1ToRow(a, row);
+        case COSINE:    return cosineToRow(a, row);
     }
-    
     throw invalid_metric();
 }
 
-// Rebuild the AVL tree so that the provided `newRoot` becomes the actual AVL root.
-// This implementation uses an inorder traversal to obtain the records in
-// ascending order by distance (so no sorting or extra headers are required),
-// then builds a balanced BST and forces the chosen index as the root.
-static void collectInorderRecords(AVLTree<double, VectorRecord>::AVLNode* node, vector<VectorRecord>& out) {
-    if (!node) return;
-    collectInorderRecords(node->pLeft, out);
-    out.push_back(node->data);
-    collectInorderRecords(node->pRight, out);
-}
-
-static AVLTree<double, VectorRecord>::AVLNode* buildBalancedFromRange(const vector<VectorRecord>& records, int l, int r) {
-    if (l > r) return nullptr;
-    int mid = (l + r) / 2;
-    AVLTree<double, VectorRecord>::AVLNode* node = new AVLTree<double, VectorRecord>::AVLNode(records[mid].distanceFromReference, records[mid]);
-    node->pLeft = buildBalancedFromRange(records, l, mid - 1);
-    node->pRight = buildBalancedFromRange(records, mid + 1, r);
-    node->balance = EH;
-    return node;
-}
-
-void VectorStore::rebuildTreeWithNewRoot(VectorRecord* newRoot) {
-    if (newRoot == nullptr) return;
-
-    // Collect records in sorted order (inorder traversal of AVL)
-    vector<VectorRecord> records;
-    records.reserve(this->count);
-    collectInorderRecords(this->vectorStore->getRoot(), records);
-
-    if (records.empty()) return;
-
-    // Find index of chosen root by id (prefer exact id match). If not found, pick
-    // the element whose distance is closest to averageDistance.
-    int chosenIdx = -1;
-    for (size_t i = 0; i < records.size(); ++i) {
-        if (records[i].id == newRoot->id) { chosenIdx = (int)i; break; }
-    }
-    if (chosenIdx == -1) {
-        double bestDiff = -1.0;
-        for (size_t i = 0; i < records.size(); ++i) {
-            double diff = fabs(records[i].distanceFromReference - this->averageDistance);
-            if (bestDiff < 0.0 || diff < bestDiff) { bestDiff = diff; chosenIdx = (int)i; }
-        }
-    }
-
-    // Clear existing AVL nodes (we will rebuild)
-    this->vectorStore->clear();
-
-    // Force chosen element as root and attach balanced left/right subtrees
-    AVLTree<double, VectorRecord>::AVLNode* newRootNode = new AVLTree<double, VectorRecord>::AVLNode(records[chosenIdx].distanceFromReference, records[chosenIdx]);
-    newRootNode->pLeft = buildBalancedFromRange(records, 0, chosenIdx - 1);
-    newRootNode->pRight = buildBalancedFromRange(records, chosenIdx + 1, (int)records.size() - 1);
-    newRootNode->balance = EH;
+// Called at the end of every path that moves rootSlot or reshapes the AVL, so
+// the const queries (possibly on several threads) only ever read the tree.
+// The chosen record is split out of the AVL and put on top in O(log^2 n),
+// so keeping the root in place after every insert stays polylogarithmic.
+void VectorStore::rebuildRootIfNeeded() {
+    if (this->rootSlot == -1 || this->vectorStore->getRoot() == nullptr) return;
+    if (this->vectorStore->getRoot()->data == this->rootSlot) return; // already on top
 
-    this->vectorStore->root = newRootNode;
+    const VectorRecord& chosen = this->records[this->rootSlot];
+    this->vectorStore->pinRoot(IndexKey(chosen.distanceFromReference, chosen.id));
 }
 
-
-
 // Explicit template instantiation for the type used by VectorStore
-template class AVLTree<double, VectorRecord>;
+template class AVLTree<IndexKey, int>;
 template class AVLTree<double, double>;
 template class AVLTree<int, double>;
 template class AVLTree<int, int>;
 template class AVLTree<double, string>;
 template class AVLTree<int, string>;
 
-template class RedBlackTree<double, VectorRecord>;
+template class RedBlackTree<IndexKey, int>;
 template class RedBlackTree<double, double>;
 template class RedBlackTree<int, double>;
 template class RedBlackTree<int, int>;
@@ -7,6 +7,9 @@
 
 
 
+// Alignment (bytes) of the VectorStore embedding arena
+const int ARENA_ALIGNMENT = 64;
+
 // ------------------------------
 // AVL balance enum
 // ------------------------------
@@ -28,21 +31,46 @@ class AVLTree {
         public:
             K key;
             T data;
+            int box;                // subtree bounds: entry in the tree's boxes, -1 = none
             AVLNode* pLeft;
             AVLNode* pRight;
             BalanceValue balance;
+            int size;               // number of nodes in this subtree (order statistics)
 
             AVLNode(const K& key, const T& value)
-                : key(key), data(value), pLeft(nullptr), pRight(nullptr), balance(EH) {}
+                : key(key), data(value), box(-1), pLeft(nullptr), pRight(nullptr), balance(EH), size(1) {}
                 
             friend class VectorStore; // Allow VectorStore to access AVLNode members
         };
 
     protected:
         AVLNode* root;
+        // When set, insert/remove never rotate the root away: they rebalance
+        // only inside its two subtrees. Used to keep a chosen node on top.
+        bool rootPinned;
+
+        // Subtree bounds (see setBounds): a node's own point is
+        // pointOf(data, pointContext); boundDims = 0 keeps none. Each box
+        // is 2 * boundDims floats in the side array `boxes` (min, then
+        // max), so nodes pay for bounds only while they are on.
+        int boundDims;
+        const float* (*pointOf)(const T&, const void*);
+        const void* pointContext;
+        std::vector<float> boxes;
+        std::vector<int> freeBoxes;         // entries of removed nodes, reused first
 
         AVLNode* rotateRight(AVLNode*& node);
         AVLNode* rotateLeft(AVLNode*& node);
+        static int sizeOf(AVLNode* node) { return node ? node->size : 0; }
+        // Recomputes the node's size (and bounds) from its children's
+        void updateSize(AVLNode* node) {
+            node->size = 1 + sizeOf(node->pLeft) + sizeOf(node->pRight);
+            if (boundDims > 0) updateBounds(node);
+        }
+        void updateBounds(AVLNode* node);
+        void refreshBoundsHelper(AVLNode* node);
+        void deleteNode(AVLNode* node);
+        void clearBoxes(AVLNode* node);
         void clearHelper(AVLNode* node);
         int getHeightHelper(AVLNode* node) const;
         int getSizeHelper(AVLNode* node) const;
@@ -62,6 +90,18 @@ class AVLTree {
         bool containsHelper(AVLNode* node, const K& key) const;
         void inorderHelper(AVLNode* node, void (*action)(const T&)) const;
 
+        // Helpers for O(n) bulk builds from sorted arrays
+        AVLNode* buildBalancedFromRange(const std::vector<K>& keys, const std::vector<T>& values, int l, int r, int& height);
+        void collectInorder(AVLNode* node, std::vector<K>& keys, std::vector<T>& values) const;
+
+        // Helpers for re-rooting by split and join (see pinRoot)
+        int heightOf(AVLNode* node) const;
+        void refreshNode(AVLNode* node);
+        AVLNode* join(AVLNode* left, AVLNode* middle, AVLNode* right);
+        AVLNode* joinRight(AVLNode* left, AVLNode* middle, AVLNode* right);
+        AVLNode* joinLeft(AVLNode* left, AVLNode* middle, AVLNode* right);
+        void split(AVLNode* node, const K& key, AVLNode*& left, AVLNode*& found, AVLNode*& right);
+
     public:
         AVLTree();
         ~AVLTree();
@@ -70,6 +110,8 @@ class AVLTree {
         void remove(const K& key);
         bool contains(const K& key) const;
         int getHeight() const;
+        // O(1); with VECTORSTORE_DEBUG defined it is checked against a full
+        // recursive count and throws std::logic_error on a mismatch
         int getSize() const;
 
         bool empty() const;
@@ -79,6 +121,33 @@ class AVLTree {
         
         void inorderTraversal(void (*action)(const T&)) const;
 
+        // Order statistics: node holding the rank-th smallest key (0-based),
+        // and the number of keys strictly smaller than `key`. Both O(log n).
+        AVLNode* select(int rank) const;
+        int rank(const K& key) const;
+
+        // Bulk operations: replace the contents with strictly increasing keys in O(n),
+        // and dump the contents in key order
+        void buildFromSorted(const std::vector<K>& keys, const std::vector<T>& values);
+        void collectSorted(std::vector<K>& keys, std::vector<T>& values) const;
+
+        // Makes the node holding `key` the root, over an AVL subtree of every
+        // smaller key and one of every larger key, and pins it (see
+        // rootPinned). The tree is split around the key with AVL joins:
+        // O(log^2 n), nodes are relinked, not copied. False if key is absent.
+        bool pinRoot(const K& key);
+
+        // Subtree bounding boxes: every node keeps the min / max over its
+        // subtree of the first `dims` coordinates of pointOf(data, context),
+        // maintained through inserts, removals, rotations and bulk builds.
+        // dims = 0 drops them. refreshBounds recomputes them all after the
+        // points themselves changed.
+        void setBounds(int dims, const float* (*pointOf)(const T&, const void*), const void* context);
+        void refreshBounds();
+        int getBoundDims() const { return boundDims; }
+        // The node's box: boundDims minima, then boundDims maxima
+        const float* boundsOf(const AVLNode* node) const { return &boxes[(size_t)node->box * 2 * boundDims]; }
+
         AVLNode* getRoot() const { return root; }
 };
 
@@ -112,6 +181,7 @@ class RBTNode {
 
 private:
     RBTNode* root;
+    int nodeCount;          // exact number of nodes, kept by insert/remove/clear
 
 protected:
     void rotateLeft(RBTNode* node);
@@ -128,13 +198,17 @@ protected:
     void fixRemove(RBTNode* x, RBTNode* parent);
     RBTNode* findMax(RBTNode* node) const;
 
+    // Helpers for O(n) bulk builds from sorted arrays
+    RBTNode* buildFromRange(const std::vector<K>& keys, const std::vector<T>& values, int l, int r, int depth, int redDepth);
+    void collectInorder(RBTNode* node, std::vector<K>& keys, std::vector<T>& values) const;
+
 
 public:
     RedBlackTree();
     ~RedBlackTree();
     
     bool empty() const;
-    int size() const;
+    int size() const;                   // O(1); checked like AVLTree::getSize under VECTORSTORE_DEBUG
     void clear();
     void insert(const K& key, const T& value);
     void remove(const K& key);
@@ -144,10 +218,58 @@ public:
     RBTNode* lowerBound(const K& key, bool& found) const;
     RBTNode* upperBound(const K& key, bool& found) const;
 
+    // Bulk operations: replace the contents with strictly increasing keys in O(n),
+    // and dump the contents in key order
+    void buildFromSorted(const std::vector<K>& keys, const std::vector<T>& values);
+    void collectSorted(std::vector<K>& keys, std::vector<T>& values) const;
+
     void printTreeStructure() const;
 };
 
 
+// ------------------------------
+// FloatRow: a record's view of its arena row
+// ------------------------------
+// VectorRecord::vector used to own a heap std::vector<float>; the rows now
+// live in the VectorStore arena and this keeps the old pointer syntax
+// working over them: (*rec.vector)[i], rec.vector->size(), ->at(i), range
+// for, and a copy as a std::vector<float>. It also converts to float* for
+// code that wants the raw row.
+class FloatRow {
+    public:
+        FloatRow() : values(nullptr), count(0) {}
+        FloatRow(float* values, int count) : values(values), count(count) {}
+
+        float& operator[](size_t i) const { return values[i]; }
+        float& at(size_t i) const {
+            if (i >= size()) throw std::out_of_range("Row index out of range!");
+            return values[i];
+        }
+        size_t size() const { return (size_t)count; }
+        bool empty() const { return count == 0; }
+        float* data() const { return values; }
+        float* begin() const { return values; }
+        float* end() const { return values + count; }
+        operator std::vector<float>() const { return std::vector<float>(begin(), end()); }
+
+    private:
+        float* values;
+        int count;
+};
+
+class RowPointer {
+    public:
+        RowPointer() {}
+        RowPointer(float* values, int count) : row(values, count) {}
+
+        const FloatRow& operator*() const { return row; }
+        const FloatRow* operator->() const { return &row; }
+        operator float*() const { return row.data(); }
+
+    private:
+        FloatRow row;
+};
+
 // ------------------------------
 // VectorRecord
 // ------------------------------
@@ -156,38 +278,455 @@ class VectorRecord {
         int id;                             
         std::string rawText;                
         int rawLength;                      
-        std::vector<float>* vector;         
+        int slot;                           // row index in the VectorStore arena (-1 if detached)
+        RowPointer vector;                  // view of the arena row (dimension floats)
+        const unsigned short* packed;       // view of the 16-bit copy of the row (nullptr at FP32)
         double distanceFromReference;       
 
         double norm;
 
         VectorRecord()
-            : id(-1), rawLength(0), vector(nullptr), distanceFromReference(0.0) {}
+            : id(-1), rawLength(0), slot(-1), packed(nullptr), distanceFromReference(0.0), norm(0.0) {}
 
         VectorRecord(int _id,
                     const std::string& _rawText,
-                    std::vector<float>* _vec,
+                    int _slot,
+                    RowPointer _vec,
                     double _dist)
             : id(_id),
             rawText(_rawText),
             rawLength(static_cast<int>(_rawText.size())),
+            slot(_slot),
             vector(_vec),
-            distanceFromReference(_dist) {}
+            packed(nullptr),
+            distanceFromReference(_dist),
+            norm(0.0) {}
 
         // Overload operator << to print only the id
         friend std::ostream& operator<<(std::ostream& os, const VectorRecord& record);
 };
 
+// ------------------------------
+// Distance metrics
+// ------------------------------
+enum Metric { EUCLIDEAN, MANHATTAN, COSINE };
+
+// Maps "euclidean" / "manhattan" / "cosine" to a Metric; throws invalid_metric otherwise
+Metric parseMetric(const std::string& name);
+
+// topKNearest: APPROXIMATE scores only the estimated norm band (may return
+// fewer than k ids); EXACT widens the band until the k best are provably found;
+// HNSW walks the graph index (see VectorStore::enableHNSW); IVF scores the
+// closest cells of the inverted file (see VectorStore::enableIVF); PQ scans
+// the product-quantized codes (see VectorStore::enablePQ); INT8 scans the
+// scalar-quantized rows (see VectorStore::enableInt8); SIMHASH ranks by
+// signature Hamming distance, cosine only (see VectorStore::enableSimHash)
+enum SearchMode { APPROXIMATE, EXACT, HNSW, IVF, PQ, INT8, SIMHASH };
+
+// Precision the embeddings are stored at (see VectorStore::setStoragePrecision)
+enum StoragePrecision { FP32, FP16, BF16 };
+
+// ------------------------------
+// IndexKey: key of VectorStore's trees
+// ------------------------------
+// Orders by value (distance or norm) and breaks ties by record id, so records
+// with equal values each keep their own node and the trees stay in sync with
+// the record table. Range scans compare `value` only and see every tie.
+class IndexKey {
+    public:
+        double value;
+        int id;
+
+        IndexKey() : value(0.0), id(-1) {}
+        IndexKey(double _value, int _id) : value(_value), id(_id) {}
+
+        bool operator<(const IndexKey& other) const {
+            return value < other.value || (value == other.value && id < other.id);
+        }
+        bool operator>(const IndexKey& other) const { return other < *this; }
+        bool operator<=(const IndexKey& other) const { return !(other < *this); }
+        bool operator>=(const IndexKey& other) const { return !(*this < other); }
+        bool operator==(const IndexKey& other) const { return value == other.value && id == other.id; }
+        bool operator!=(const IndexKey& other) const { return !(*this == other); }
+};
+
+class PivotFilter; // LAESA lower bounds for one query (VectorStore.cpp)
+
+// ------------------------------
+// IdIndex: open-addressing hash map from record id to slot
+// ------------------------------
+class IdIndex {
+    private:
+        static const int EMPTY_KEY = -1;
+        static const int TOMBSTONE_KEY = -2;
+
+        int* keys;          // record id, EMPTY_KEY or TOMBSTONE_KEY
+        int* values;        // slot of the record
+        int capacity;       // always a power of two
+        int used;           // live entries + tombstones
+        int live;
+
+        int bucketFor(int id) const;
+        void rehash(int newCapacity);
+
+    public:
+        IdIndex();
+        ~IdIndex();
+
+        void insert(int id, int slot);
+        int find(int id) const;             // slot, or -1 if absent
+        bool erase(int id);
+        void clear();
+        int size() const { return live; }
+};
+
+// ------------------------------
+// HNSWIndex: hierarchical navigable small-world graph over arena slots
+// ------------------------------
+// Approximate nearest-neighbor index (Malkov & Yashunin). Nodes are arena
+// slots and vectors are read from the arena passed to each call, so the
+// index only stores links: level 0 in one flat array (up to 2M links per
+// node), upper levels per node (up to M links). Removed slots are
+// tombstoned: they keep routing searches but are never returned.
+class HNSWIndex {
+    private:
+        Metric metric;
+        int dimension;
+        int M;                              // links per node on upper levels
+        int maxM0;                          // links per node on level 0
+        int efConstruction;
+        double levelScale;                  // 1 / ln(M)
+        unsigned long long rngState;        // xorshift64* state for node levels
+
+        std::vector<int> levels;            // per slot: top level, -1 = not in the graph
+        std::vector<char> deleted;          // per slot: tombstone
+        std::vector<int> level0;            // per slot: [count, links...], stride maxM0 + 1
+        std::vector<std::vector<int>> upper;// per slot: levels 1..top, stride M + 1 each
+        int entryPoint;                     // slot, -1 if empty
+        int maxLevel;
+        int nodeCount;
+        int deletedCount;
+
+        // Visited marks for searches: visitTag[slot] == visitEpoch means seen
+        std::vector<unsigned> visitTag;
+        unsigned visitEpoch;
+
+        double distance(const float* a, const float* b) const;
+        int* linksOf(int slot, int level);
+        const int* linksOf(int slot, int level) const;
+        int randomLevel();
+        void reserveSlot(int slot);
+        void nextVisitEpoch();
+        int greedyClosest(const float* query, int start, int level, const float* arena, int& evaluated);
+        void searchLayer(const float* query, const std::vector<std::pair<double, int>>& entries, int ef, int level,
+                         bool liveOnly, const float* arena, std::vector<std::pair<double, int>>& found, int& evaluated);
+        void selectNeighbors(const std::vector<std::pair<double, int>>& candidates, int maxLinks,
+                             const float* arena, std::vector<int>& chosen) const;
+        void setLinks(int slot, int level, const std::vector<int>& links);
+        void addLink(int from, int to, int level, const float* arena);
+
+    public:
+        HNSWIndex(Metric metric, int dimension, int M, int efConstruction);
+
+        void insert(int slot, const float* arena);
+        void markDeleted(int slot);
+        void clear();
+
+        // Up to k live (distance, slot) pairs closest to query, closest first.
+        // ef (>= k) is the search beam width. Not safe to call concurrently.
+        std::vector<std::pair<double, int>> search(const float* query, int k, int ef,
+                                                   const float* arena, int& evaluated);
+
+        Metric getMetric() const { return metric; }
+        int size() const { return nodeCount - deletedCount; }
+        int tombstones() const { return deletedCount; }
+};
+
+// ------------------------------
+// IVFIndex: inverted file over k-means cells
+// ------------------------------
+// The store is split into up to nlist cells by k-means; every slot sits in
+// the posting list of its closest centroid, and a query only scores the
+// slots of its nprobe closest cells. Like HNSWIndex it reads rows from the
+// arena passed to each call. Posting lists are unordered: a slot leaves its
+// list by swapping with the last entry.
+class IVFIndex {
+    private:
+        Metric metric;
+        int dimension;
+        int nlist;                          // cells wanted
+        int cells;                          // cells trained, min(nlist, records); 0 = untrained
+        unsigned long long rngState;        // xorshift64* state for seeding and sampling
+
+        std::vector<float> centroids;       // cells x dimension
+        std::vector<std::vector<int>> postings;
+        std::vector<int> cellOf;            // per slot: its cell, -1 = not indexed
+        std::vector<int> positionOf;        // per slot: index in its posting list
+        int members;
+        int trainedSize;                    // records the centroids were trained on
+        int updatesSinceTraining;
+
+        double distance(const float* a, const float* b) const;
+        int nearestCell(const float* row) const;
+        void assignParallel(const float* arena, const int* slots, int n, int* nearest, int threads) const;
+        void reserveSlot(int slot);
+
+    public:
+        IVFIndex(Metric metric, int dimension, int nlist);
+
+        // Mini-batch k-means over the given slots; forgets the posting lists
+        void train(const float* arena, const std::vector<int>& slots, int threads);
+        // Rebuilds the posting lists: every slot goes to its closest centroid
+        void assign(const float* arena, const std::vector<int>& slots, int threads);
+        void setCentroid(int cell, const float* values);
+
+        void insert(int slot, const float* arena);
+        void remove(int slot);
+        void clear();
+        // Untrained, trained on a much smaller store, or one cell holding far
+        // more than its share, once enough has changed since the last training
+        bool needsRetraining(int storeSize) const;
+
+        // Appends the slots of the nprobe cells closest to query, closest cell
+        // first; evaluated = centroid distances computed
+        void probe(const float* query, int nprobe, std::vector<int>& candidates, int& evaluated) const;
+
+        const std::vector<int>& postingList(int cell) const { return postings[cell]; }
+        Metric getMetric() const { return metric; }
+        int cellCount() const { return cells; }
+        int size() const { return members; }
+};
+
+// ------------------------------
+// ProductQuantizer: m-byte codes with asymmetric distance computation
+// ------------------------------
+// The dimensions are split into m contiguous subspaces, each with a k-means
+// codebook of up to 256 codewords; a row is stored as the m codeword indices
+// closest to its sub-vectors. A query builds one table of per-subspace terms
+// (squared L2, L1 or dot product against every codeword), after which
+// scoring a code is m table lookups.
+class ProductQuantizer {
+    private:
+        int dimension;
+        int subspaces;
+        int codewords;                      // per subspace, min(256, records); 0 = untrained
+        std::vector<int> subStart;          // subspace s covers dimensions [subStart[s], subStart[s + 1])
+        std::vector<float> codebooks;       // subspace s: codewords x its width, at codewords * subStart[s]
+        std::vector<unsigned char> codes;   // per slot: subspaces bytes
+        int trainedSize;
+
+        void reserveSlot(int slot);
+        void encodeRow(const float* row, unsigned char* code) const;
+
+    public:
+        ProductQuantizer(int dimension, int subspaces);
+
+        // k-means per subspace on (a sample of) the given slots, then encodes them all
+        void train(const float* arena, const std::vector<int>& slots, int threads);
+        void encode(int slot, const float* row);
+        void clear();
+        // Untrained, or trained on a sample that the store has since doubled
+        bool needsRetraining(int storeSize) const;
+
+        // table[s * 256 + c]: the subspace-s term of metric between query and codeword c
+        void buildTable(const float* query, Metric metric, std::vector<float>& table) const;
+        // Sum of the slot's table terms (squared L2, L1 or dot product)
+        double lookup(int slot, const float* table) const {
+            const unsigned char* code = &codes[(size_t)slot * subspaces];
+            double total = 0.0;
+            for (int s = 0; s < subspaces; ++s) total += table[s * 256 + code[s]];
+            return total;
+        }
+
+        bool trained() const { return codewords > 0; }
+        int subspaceCount() const { return subspaces; }
+};
+
+// ------------------------------
+// ScalarQuantizer: one byte per dimension
+// ------------------------------
+// Dimension i is mapped linearly onto 0..255 over the range [offset_i,
+// offset_i + 255 * scale_i] seen in training, so code c stands for
+// offset_i + scale_i * c (values outside the range are clamped). Rows are
+// scored against a per-query float operand with the code kernels; euclidean
+// goes through the dot product kernel, using each row's stored
+// sum (scale_i * c_i)^2.
+class ScalarQuantizer {
+    private:
+        int dimension;
+        bool isTrained;
+        std::vector<float> offset;          // per dimension
+        std::vector<float> scale;           // per dimension
+        std::vector<float> kernelScale;     // scale in the kernels' code order
+        std::vector<unsigned char> codes;   // per slot: dimension bytes
+        std::vector<float> rowTerms;        // per slot: sum (scale_i * c_i)^2
+        int trainedSize;
+        int clampedSinceTraining;           // rows encoded outside the trained range
+
+        void reserveSlot(int slot);
+        bool encodeRow(const float* row, unsigned char* code, float& rowTerm) const; // false if clamped
+
+    public:
+        explicit ScalarQuantizer(int dimension);
+
+        // Learns every dimension's range from the given slots, then encodes them
+        void train(const float* arena, const std::vector<int>& slots, int threads);
+        void encode(int slot, const float* row);
+        void clear();
+        // Untrained, doubled since training, or too many rows clamped
+        bool needsRetraining(int storeSize) const;
+
+        // Per-query operand, in code order: u = query - offset (l1),
+        // u * scale (l2, with bias = |u|^2) or query * scale (cosine, with
+        // bias = sum query * offset)
+        void prepareQuery(const float* query, Metric metric, std::vector<float>& operand, double& bias) const;
+
+        const unsigned char* codeOf(int slot) const { return &codes[(size_t)slot * dimension]; }
+        float rowTerm(int slot) const { return rowTerms[slot]; }
+        const float* scales() const { return kernelScale.data(); } // code order
+        bool trained() const { return isTrained; }
+};
+
+// ------------------------------
+// SimHasher: random-hyperplane sign signatures
+// ------------------------------
+// Bit b of a row's signature is the sign of its dot product with random
+// Gaussian direction b, so two rows disagree on a bit with probability
+// angle / pi (Charikar 2002) and the Hamming distance h between signatures
+// estimates their cosine as cos(pi * h / bits). The directions do not depend
+// on the data, so signatures never need retraining.
+class SimHasher {
+    private:
+        int dimension;
+        int bits;                                       // multiple of 64
+        std::vector<float> directions;                  // bits rows of dimension floats
+        std::vector<unsigned long long> signatures;     // per slot: bits / 64 words
+
+        void reserveSlot(int slot);
+
+    public:
+        SimHasher(int dimension, int bits);
+
+        void sign(const float* row, unsigned long long* signature) const;
+        void encode(int slot, const float* arena);
+        void clear();
+
+        const unsigned long long* signatureOf(int slot) const { return &signatures[(size_t)slot * words()]; }
+        int words() const { return bits / 64; }
+        int bitCount() const { return bits; }
+};
+
+// ------------------------------
+// KDTree: k-d tree with leaf buckets for box queries
+// ------------------------------
+// Leaves hold up to leafSize slots; a fuller leaf is split at the midpoint
+// of its widest dimension (rows below the split go left). Inserts and
+// removals are incremental; a box query only descends into children whose
+// side of the split can hold a point strictly inside the box.
+class KDTree {
+    private:
+        struct Node {
+            int splitDim;                   // -1 for a leaf
+            float splitValue;
+            int left, right;                // child node indices
+            std::vector<int> bucket;        // leaf slots
+            int capacity;                   // leaf splits once the bucket outgrows this
+        };
+
+        int dimension;
+        int leafSize;
+        std::vector<Node> nodes;            // nodes[0] is the root
+        std::vector<int> leafOf;            // per slot: leaf holding it (-1 = none)
+        int members;
+
+        int newLeaf();
+        void splitLeaf(int leaf, const float* arena);
+
+    public:
+        KDTree(int dimension, int leafSize);
+
+        void build(const float* arena, const std::vector<int>& slots);
+        void insert(int slot, const float* arena);
+        void remove(int slot);
+        void clear();
+
+        // Appends the slots whose rows lie strictly inside (minBound, maxBound);
+        // evaluated = rows tested
+        void query(const float* arena, const float* minBound, const float* maxBound,
+                   std::vector<int>& matches, int& evaluated) const;
+        int size() const { return members; }
+};
+
 // ------------------------------
 // VectorStore
 // ------------------------------
 class VectorStore {
     private:
-        AVLTree<double, VectorRecord>* vectorStore;
-        RedBlackTree<double, VectorRecord>* normIndex;
+        // Authoritative record table, indexed by slot. Both trees store
+        // slots only, so each record (and its rawText) exists exactly once.
+        VectorRecord* records;
+        AVLTree<IndexKey, int>* vectorStore;          // distance from reference -> slot
+        RedBlackTree<IndexKey, int>* normIndex;       // norm -> slot
 
         std::vector<float>* referenceVector;
-        VectorRecord* rootVector;
+        int rootSlot;                               // slot chosen as AVL root (closest to average), -1 if empty
+                                                    // kept on top by every mutation, see rebuildRootIfNeeded
+
+        // Embedding storage: one aligned block of rows, `dimension` floats each.
+        // Row `slot` belongs to records[slot]; slots freed by removeAt are reused.
+        float* arena;
+        int arenaCapacity;                  // rows allocated (arena and record table)
+        int arenaSize;                      // rows handed out so far (high-water mark)
+        std::vector<int> freeSlots;
+
+        // Below FP32 every row is rounded to `precision` when it is stored and
+        // packedRows keeps its 16-bit copy (same slot layout as the arena),
+        // which the exact scans read instead of the float row
+        StoragePrecision precision;
+        std::vector<unsigned short> packedRows;
+
+        // LAESA pivots: pivotVectors holds pivotsChosen rows of `dimension` floats,
+        // pivotTable[slot * pivotTarget + p] the L2 distance from records[slot] to pivot p
+        int pivotTarget;                            // pivots requested (0 = off)
+        int pivotsChosen;
+        int pivotSelectionCount;                    // store size at the last selection
+        std::vector<float> pivotVectors;
+        std::vector<float> pivotTable;
+
+        // Optional HNSW graph (nullptr = off). While it is on, removed slots wait
+        // in hnswPendingSlots (the graph still routes through their rows) until
+        // the graph is rebuilt without them.
+        HNSWIndex* hnsw;
+        int hnswEfSearch;
+        std::vector<int> hnswPendingSlots;
+
+        // Optional inverted file (nullptr = off), probed ivfProbes cells deep
+        IVFIndex* ivf;
+        int ivfProbes;
+
+        // Optional quantized copies of the rows (nullptr = off): product codes
+        // and one byte per dimension. Searches on either re-score their best
+        // rerankDepth candidates against the full rows (0 = no re-rank).
+        ProductQuantizer* pq;
+        ScalarQuantizer* int8Codes;
+        int rerankDepth;
+        // After dropFloatRows the arena is gone and the codes are the only copy:
+        // each new embedding is staged in stagingRow just long enough to encode
+        bool rowsDropped;
+        std::vector<float> stagingRow;
+
+        // Optional SimHash signatures (nullptr = off); a SIMHASH search
+        // re-scores its best simHashCandidates records exactly (0 = none)
+        SimHasher* simHash;
+        int simHashCandidates;
+
+        // Optional k-d tree over the rows (nullptr = off) for boundingBoxQuery
+        KDTree* kdTree;
+        // The AVL's subtree bounds read the rows through this (store = this)
+        static const float* rowOfSlot(const int& slot, const void* store);
+
+        IdIndex* idIndex;                           // id -> slot
+        int nextId;                                 // next id handed out by addText
 
         int dimension;
         int count;
@@ -195,15 +734,50 @@ class VectorStore {
 
         std::vector<float>* (*embeddingFunction)(const std::string&);
 
+        int workerThreads;                          // 0 = one per hardware thread
+        int ingestWindow;                           // max embeddings in flight in addTexts
+        mutable int lastDistanceEvaluations;        // see getLastDistanceEvaluations
+
         double distanceByMetric(const std::vector<float>& a,
-                                const std::vector<float>& b,
-                                const std::string& metric) const;
+                                const float* row,
+                                Metric metric) const;
+
+        double cosineToRow(const std::vector<float>& v, const float* row) const;
+        double l1ToRow(const std::vector<float>& v, const float* row) const;
+        double l2ToRow(const std::vector<float>& v, const float* row) const;
 
         void rebuildRootIfNeeded();
-        void rebuildTreeWithNewRoot(VectorRecord* newRoot);
+        void requireFloatRows() const;
+        void rekeyByDistance();
+        void removeSlot(int slot);
+        int storeRecord(const std::string& rawText, std::vector<float>* vec);
+        void admitRecord(int slot);
+        void indexBatch(std::vector<IndexKey>& distKeys, std::vector<IndexKey>& normKeys, std::vector<int>& newSlots);
+        int threadCount() const;
+        void selectPivots();
+        void updatePivots();
+        PivotFilter pivotFilterFor(const std::vector<float>& query) const;
+        void rebuildHNSW();
+        int* searchHNSW(const std::vector<float>& query, int k, Metric metric, int& found);
+        void trainIVF();
+        void retrainIndexesIfNeeded();
+        int* searchIVF(const std::vector<float>& query, int k, Metric metric, int& found);
+        void trainPQ();
+        void trainInt8();
+        int* searchInt8(const std::vector<float>& query, int k, Metric metric);
+        int* searchPQ(const std::vector<float>& query, int k, Metric metric);
+        void encodeSimHash();
+        int* searchSimHash(const std::vector<float>& query, int k, Metric metric);
+        void rebuildKDTree();
 
         VectorRecord* findVectorNearestToDistance(double targetDistance) const; 
 
+        int allocateSlot();
+        void releaseSlot(int slot);
+        void growArena(int minRows);
+        float* rowAt(int slot) const { return arena + (size_t)slot * dimension; }
+        void packRow(int slot);
+
     public:
         VectorStore(int dimension,
                     std::vector<float>* (*embeddingFunction)(const std::string&),
@@ -217,22 +791,134 @@ class VectorStore {
         std::vector<float>* preprocessing(std::string rawText);
         void addText(std::string rawText);
 
+        // Bulk ingestion: same ids, contents and root as calling addText on each
+        // text in order, but both trees are rebuilt once from sorted arrays.
+        // With -DVECTORSTORE_THREADS the embeddings are computed on worker threads,
+        // so embeddingFunction must then be safe to call concurrently.
+        void addTexts(const std::vector<std::string>& rawTexts);
+        template <class InputIt>
+        void addTexts(InputIt first, InputIt last) {
+            addTexts(std::vector<std::string>(first, last));
+        }
+
         VectorRecord* getVector(int index);        
         std::string   getRawText(int index);
         int           getId(int index);
 
         bool removeAt(int index);
 
+        // Direct access by record id (as returned by the search methods), O(1)
+        VectorRecord* getById(int id);
+        bool containsId(int id) const;
+        bool removeById(int id);
+
         void setReferenceVector(const std::vector<float>& newReference);
         std::vector<float>* getReferenceVector() const; 
         VectorRecord* getRootVector() const; 
         double getAverageDistance() const;           
         void setEmbeddingFunction(std::vector<float>* (*newEmbeddingFunction)(const std::string&));
 
+        // Number of pivots for LAESA-style pruning of euclidean/manhattan searches
+        // (0 = off). Pivots are picked farthest-first from the stored vectors and
+        // re-picked each time the store doubles; each record keeps its distance
+        // to every pivot.
+        void setPivotCount(int pivots);
+        int getPivotCount() const;
+
+        // Per-subtree bounding boxes in the AVL over the first `dims`
+        // dimensions (0 = off, the default): 2 * dims floats per record that
+        // let boundingBoxQuery and euclidean / manhattan rangeQuery skip
+        // subtrees that cannot hold a match.
+        void setSubtreeBoundDims(int dims);
+        int getSubtreeBoundDims() const;
+
+        // HNSW graph index, used by topKNearest / findNearest with SearchMode HNSW.
+        // Built for one metric from the current contents and kept up to date by
+        // addText / removeAt. M: links per node, efConstruction / efSearch: beam
+        // widths while inserting / searching.
+        void enableHNSW(Metric metric, int M = 16, int efConstruction = 200);
+        void disableHNSW();
+        void setEfSearch(int ef);
+
+        // Inverted-file index, used by topKNearest / findNearest with SearchMode IVF.
+        // k-means splits the store into nlist cells (retrained as the store
+        // grows or the cells become imbalanced); a query scores the records of
+        // its nprobe closest cells, so nprobe trades recall for latency.
+        void enableIVF(Metric metric, int nlist = 256);
+        void disableIVF();
+        void setNProbe(int nprobe);
+
+        // Product quantization, used by topKNearest / findNearest / rangeQuery
+        // with SearchMode PQ. Every row is also kept as m one-byte codes that
+        // are scored with per-query lookup tables; with a re-rank depth R > 0
+        // the best max(k, R) codes (or every range match) are checked against
+        // the full vectors.
+        void enablePQ(int subspaces = 8);
+        void disablePQ();
+
+        // Int8 scalar quantization, used by topKNearest / findNearest /
+        // rangeQuery with SearchMode INT8: one byte per dimension with a
+        // per-dimension scale and offset learned from the stored rows.
+        void enableInt8();
+        void disableInt8();
+
+        // Re-rank depth R of the PQ and INT8 modes (0 = rank by codes only)
+        void setRerankDepth(int candidates);
+
+        // Frees the float rows, leaving the trained PQ and / or INT8 codes as
+        // the only copy of the embeddings: 4 * dimension bytes per record
+        // become one byte per subspace (PQ) or per dimension (INT8). Those
+        // searches then rank by codes alone (the re-rank depth is ignored),
+        // the codebooks and int8 ranges stay as trained (rows outside the
+        // ranges are clamped) and new texts are encoded on arrival. Everything that reads the rows throws
+        // logic_error from then on: the other search modes, boundingBoxQuery,
+        // forEach, computeCentroid, setReferenceVector, setStoragePrecision,
+        // pivots, subtree bounds and the other indexes (which must be off
+        // when the rows are dropped). getVector hands out empty rows.
+        // clear() brings the float rows back.
+        void dropFloatRows();
+        bool hasFloatRows() const;
+
+        // SimHash signatures, used by topKNearest / findNearest with SearchMode
+        // SIMHASH (cosine only): `bits` random-hyperplane sign bits per record
+        // (a multiple of 64). The Hamming scan is a prefilter for the norm-blind
+        // cosine case; its best candidates (256 by default) are re-scored exactly.
+        void enableSimHash(int bits = 256);
+        void disableSimHash();
+        void setSimHashCandidates(int candidates);
+
+        // K-d tree with leafSize-slot buckets, used by boundingBoxQuery: a
+        // box then only tests the rows of the leaves it overlaps instead of
+        // every record. Kept up to date by addText / removeAt.
+        void enableKDTree(int leafSize = 16);
+        void disableKDTree();
+
+        // Storage precision of the embeddings (FP32 by default). FP16 / BF16
+        // halve the bytes the exact scans stream: preprocessing rounds each
+        // embedding once and the scans widen the 16-bit rows in registers.
+        // getVector still hands out float rows, holding the rounded values.
+        // Switching a non-empty store rounds the rows already stored (going
+        // back to FP32 keeps them rounded) and rebuilds every index.
+        void setStoragePrecision(StoragePrecision precision);
+        StoragePrecision getStoragePrecision() const;
+
+        // Parallelism knobs (only effective when built with -DVECTORSTORE_THREADS)
+        void setWorkerThreads(int threads);         // 0 = one per hardware thread
+        void setIngestWindow(int texts);            // embeddings buffered per addTexts round
+
         void forEach(void (*action)(std::vector<float>&, int, std::string&));
         std::vector<int> getAllIdsSortedByDistance() const;
         std::vector<VectorRecord*> getAllVectorsSortedByDistance() const;
 
+        // Records scored by the last findNearest / topKNearest / rangeQuery /
+        // boundingBoxQuery call (for benchmarking pruning; not meaningful with
+        // concurrent queries)
+        int getLastDistanceEvaluations() const;
+
+        // Name of the distance kernel family picked for this CPU ("avx512f",
+        // "avx2+fma", "simd128" or "scalar")
+        static const char* distanceKernelName();
+
         double cosineSimilarity(const std::vector<float>& v1, const std::vector<float>& v2);
         double l1Distance(const std::vector<float>& v1, const std::vector<float>& v2);
         double l2Distance(const std::vector<float>& v1, const std::vector<float>& v2);
@@ -244,15 +930,24 @@ class VectorStore {
 
         double estimateD_Linear(const std::vector<float>& query, int k, double averageDistance, const std::vector<float>& reference, double c0_bias = 1e-9, double c1_slope = 0.05);
 
+        // Searches take a Metric; the string overloads parse the name once and forward
+        int findNearest(const std::vector<float>& query, Metric metric, SearchMode mode = EXACT);
+        int* topKNearest(const std::vector<float>& query, int k, Metric metric, SearchMode mode = APPROXIMATE);
         int findNearest(const std::vector<float>& query, std::string metric = "cosine");
         int* topKNearest(const std::vector<float>& query, int k, std::string metric = "cosine");
+        // One result per query (ids, closest first), identical to topKNearest on
+        // each query but with the candidate scan shared across the batch
+        std::vector<std::vector<int>> topKNearestBatch(const std::vector<std::vector<float>>& queries, int k, Metric metric);
 
         int* rangeQueryFromRoot(double minDist, double maxDist) const;
+        int* rangeQuery(const std::vector<float>& query, double radius, Metric metric, SearchMode mode = EXACT) const;
         int* rangeQuery(const std::vector<float>& query, double radius, std::string metric = "cosine") const;
         int* boundingBoxQuery(const std::vector<float>& minBound, const std::vector<float>& maxBound) const;
 
         double getMaxDistance() const;
         double getMinDistance() const;
+        // The centroid's row is not in the arena: the caller frees it with
+        // delete[] centroid.vector
         VectorRecord computeCentroid(const std::vector<VectorRecord*>& records) const;
 };
 
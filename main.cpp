@@ -439,6 +439,850 @@ void test_006() {
     cout << "=========================================" << endl;
 }
 
+// ====================================================
+// TEST 007: AVL Order Statistics
+// Covers: select(rank), rank(key), sizes through rotations and removals
+// ====================================================
+void test_007() {
+    cout << "\n=== Test 007: AVL Order Statistics ===" << endl;
+    AVLTree<int, int> avl;
+    // 10..100 step 10 in an order that triggers LL, RR, LR and RL rotations
+    int keys[] = {50, 20, 80, 10, 30, 25, 90, 100, 85, 70, 60};
+    for (int k : keys) avl.insert(k, k);
+
+    cout << "Size: " << avl.getSize() << " (Exp: 11)" << endl;
+    cout << "select(0): " << avl.select(0)->key << " (Exp: 10)" << endl;
+    cout << "select(5): " << avl.select(5)->key << " (Exp: 60)" << endl;
+    cout << "select(10): " << avl.select(10)->key << " (Exp: 100)" << endl;
+    cout << "select(11) is NULL? " << (avl.select(11) == nullptr) << " (Exp: 1)" << endl;
+    cout << "rank(60): " << avl.rank(60) << " (Exp: 5)" << endl;
+    cout << "rank(55): " << avl.rank(55) << " (Exp: 5 - keys smaller than 55)" << endl;
+
+    avl.remove(50); avl.remove(10); avl.remove(85);
+    cout << "After removing 50, 10, 85:" << endl;
+    cout << "select(0): " << avl.select(0)->key << " (Exp: 20)" << endl;
+    cout << "select(4): " << avl.select(4)->key << " (Exp: 70)" << endl;
+    cout << "rank(100): " << avl.rank(100) << " (Exp: 7)" << endl;
+}
+
+// ====================================================
+// TEST 008: Access by ID
+// Covers: monotonic ids, getById, containsId, removeById
+// ====================================================
+void test_008() {
+    cout << "\n=== Test 008: Access by ID ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, testEmbedding, ref);
+    vs.addText("A"); vs.addText("B"); vs.addText("C"); vs.addText("D"); // IDs 0..3
+
+    cout << "getById(2) text: " << vs.getById(2)->rawText << " (Exp: C)" << endl;
+    cout << "removeById(3): " << vs.removeById(3) << " (Exp: 1)" << endl;
+    cout << "removeById(3) again: " << vs.removeById(3) << " (Exp: 0)" << endl;
+    cout << "containsId(3)? " << vs.containsId(3) << " (Exp: 0)" << endl;
+    cout << "getById(99) is NULL? " << (vs.getById(99) == nullptr) << " (Exp: 1)" << endl;
+
+    // Removed ids are never handed out again
+    vs.addText("PAD");
+    cout << "New record ID: " << vs.getById(4)->id << " (Exp: 4)" << endl;
+    cout << "Size: " << vs.size() << " (Exp: 4)" << endl;
+}
+
+// ====================================================
+// TEST 009: Duplicate Distances and Norms
+// Covers: equal embeddings stay indexed, norm filter sees every tie
+// ====================================================
+void test_009() {
+    cout << "\n=== Test 009: Duplicate Distances and Norms ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, testEmbedding, ref);
+    vs.addText("A"); vs.addText("A"); vs.addText("B"); vs.addText("A"); // IDs 0, 1, 2, 3
+
+    vector<int> ids = vs.getAllIdsSortedByDistance();
+    cout << "IDs sorted by Dist: [ ";
+    for (int id : ids) cout << id << " ";
+    cout << "] (Exp: 0 1 3 2)" << endl;
+
+    int* inRange = vs.rangeQueryFromRoot(1.0, 1.0);
+    cout << "Range [1, 1] (Exp IDs: 0, 1, 3): ";
+    printArray(inRange, 3);
+    delete[] inRange;
+
+    vs.removeById(1);
+    cout << "After removeById(1), index 1 ID: " << vs.getId(1) << " (Exp: 3)" << endl;
+    cout << "Size: " << vs.size() << " (Exp: 3)" << endl;
+}
+
+// ====================================================
+// TEST 010: Bulk Ingestion
+// Covers: addTexts matches repeated addText (order, root, size)
+// ====================================================
+void test_010() {
+    cout << "\n=== Test 010: Bulk Ingestion ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore one(2, testEmbedding, ref), bulk(2, testEmbedding, ref);
+    vector<string> texts = {"C", "A", "B", "A", "C"};
+    for (const string& t : texts) one.addText(t);
+    bulk.addTexts(texts);
+
+    vector<int> a = one.getAllIdsSortedByDistance(), b = bulk.getAllIdsSortedByDistance();
+    cout << "IDs sorted by Dist: [ ";
+    for (int id : b) cout << id << " ";
+    cout << "] " << (a == b ? "matches addText" : "DIFFERS from addText") << endl;
+    cout << "Root ID: " << bulk.getRootVector()->id << " (Exp: " << one.getRootVector()->id << ")" << endl;
+    cout << "Size: " << bulk.size() << " (Exp: 5)" << endl;
+}
+
+// ====================================================
+// TEST 011: Distance Kernels
+// Covers: dispatched SIMD kernels agree with a double-precision reference
+// ====================================================
+void test_011() {
+    cout << "\n=== Test 011: Distance Kernels vs Double Reference ===" << endl;
+    cout << "Kernel: " << VectorStore::distanceKernelName() << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, testEmbedding, ref);
+
+    // Lengths around every lane width, so main loops and tails are both hit
+    double worst = 0.0;
+    unsigned seed = 12345;
+    for (int n = 1; n <= 100; ++n) {
+        vector<float> a(n), b(n);
+        for (int i = 0; i < n; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            a[i] = (float)((seed >> 8) % 2000) / 100.0f - 10.0f;
+            seed = seed * 1103515245u + 12345u;
+            b[i] = (float)((seed >> 8) % 2000) / 100.0f - 10.0f;
+        }
+        double l1 = 0.0, l2 = 0.0, dot = 0.0, na = 0.0, nb = 0.0;
+        for (int i = 0; i < n; ++i) {
+            double x = a[i], y = b[i];
+            l1 += fabs(x - y);
+            l2 += (x - y) * (x - y);
+            dot += x * y;
+            na += x * x;
+            nb += y * y;
+        }
+        l2 = sqrt(l2);
+        double cosine = dot / (sqrt(na) * sqrt(nb));
+
+        worst = max(worst, fabs(vs.l1Distance(a, b) - l1) / max(1.0, l1));
+        worst = max(worst, fabs(vs.l2Distance(a, b) - l2) / max(1.0, l2));
+        worst = max(worst, fabs(vs.cosineSimilarity(a, b) - cosine));
+    }
+    cout << "Max relative error below 1e-5: " << (worst < 1e-5 ? "yes" : "NO") << endl;
+}
+
+// ====================================================
+// TEST 012: Batched Top-K
+// Covers: topKNearestBatch returns what topKNearest returns per query
+// ====================================================
+void test_012() {
+    cout << "\n=== Test 012: Batched Top-K ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, testEmbedding, ref);
+    vs.addTexts({"A", "B", "C", "D", "AB", "CD", "BA"});
+
+    vector<vector<float>> queries = {{1.0, 0.0}, {4.5, 0.0}, {66.0, 66.0}};
+    vector<vector<int>> batch = vs.topKNearestBatch(queries, 2, EUCLIDEAN);
+    bool same = true;
+    for (size_t q = 0; q < queries.size(); ++q) {
+        int* single = vs.topKNearest(queries[q], 2, EUCLIDEAN);
+        for (size_t i = 0; i < batch[q].size(); ++i) {
+            if (batch[q][i] != single[i]) same = false;
+        }
+        delete[] single;
+    }
+    cout << "Query {1, 0} top-2 IDs: ";
+    for (int id : batch[0]) cout << id << " ";
+    cout << "(Exp: 0 1)" << endl;
+    cout << "Batch matches single queries: " << (same ? "yes" : "NO") << endl;
+}
+
+// ====================================================
+// TEST 013: Exact Top-K
+// Covers: EXACT mode returns k ids even when the estimated band is too narrow
+// ====================================================
+void test_013() {
+    cout << "\n=== Test 013: Exact Top-K ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, testEmbedding, ref);
+    vs.addTexts({"A", "B", "C", "D"}); // norms 1, 2, 5, 4
+
+    // The estimated band around norm 10 only reaches C and D, so the
+    // approximate search scores 2 records for k = 3
+    int* approx = vs.topKNearest({10.0, 0.0}, 3, EUCLIDEAN);
+    delete[] approx;
+    int* exact = vs.topKNearest({10.0, 0.0}, 3, EUCLIDEAN, EXACT);
+    cout << "Exact top-3 IDs (Exp: 2, 3, 1): ";
+    printArray(exact, 3);
+    delete[] exact;
+}
+
+// ====================================================
+// TEST 014: Range Query Pruning (benchmark)
+// Covers: euclidean rangeQuery only scores the AVL key annulus
+// ====================================================
+// "i" -> point i of a 50 x 50 grid
+vector<float>* gridEmbedding(const string& text) {
+    int i = stoi(text);
+    return new vector<float>{(float)(i % 50), (float)(i / 50)};
+}
+
+void test_014() {
+    cout << "\n=== Test 014: Range Query Pruning ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, gridEmbedding, ref);
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    vs.addTexts(texts);
+
+    for (double radius : {1.0, 5.0, 20.0}) {
+        int* ids = vs.rangeQuery({25.0, 25.0}, radius, EUCLIDEAN);
+        delete[] ids;
+        int evaluations = vs.getLastDistanceEvaluations();
+        cout << "Radius " << radius << ": " << evaluations << " of " << vs.size()
+             << " distances computed (" << vs.size() - evaluations << " skipped)" << endl;
+    }
+    // Pivot lower bounds rule out most of the annulus as well
+    vs.setPivotCount(4);
+    int* ids = vs.rangeQuery({25.0, 25.0}, 5.0, EUCLIDEAN);
+    delete[] ids;
+    cout << "Radius 5 with " << vs.getPivotCount() << " pivots: " << vs.getLastDistanceEvaluations()
+         << " distances computed" << endl;
+}
+
+// ====================================================
+// TEST 015: HNSW Graph Index
+// Covers: topKNearest / findNearest with SearchMode HNSW against EXACT,
+// removals (tombstones) and the metric check
+// ====================================================
+void test_015() {
+    cout << "\n=== Test 015: HNSW Graph Index ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, gridEmbedding, ref);
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    vs.addTexts(texts);
+    vs.enableHNSW(EUCLIDEAN, 8, 64);
+
+    vector<float> query = {12.2, 30.4};
+    int* exact = vs.topKNearest(query, 5, EUCLIDEAN, EXACT);
+    int* graph = vs.topKNearest(query, 5, EUCLIDEAN, HNSW);
+    int shared = 0;
+    for (int i = 0; i < 5; ++i)
+        for (int j = 0; j < 5; ++j)
+            if (exact[i] == graph[j]) shared++;
+    cout << "HNSW top-5 shares " << shared << " of 5 ids with EXACT ("
+         << vs.getLastDistanceEvaluations() << " distances computed)" << endl;
+    delete[] exact;
+    delete[] graph;
+
+    // The nearest record goes away: the graph must not return it again
+    int nearest = vs.findNearest(query, EUCLIDEAN, HNSW);
+    vs.removeById(nearest);
+    cout << "Nearest id " << nearest << ", after removal: " << vs.findNearest(query, EUCLIDEAN, HNSW) << endl;
+
+    try {
+        vs.findNearest(query, COSINE, HNSW);
+    } catch (const invalid_metric&) {
+        cout << "Cosine on a euclidean graph throws invalid_metric" << endl;
+    }
+}
+
+// ====================================================
+// TEST 016: IVF Index
+// Covers: topKNearest with SearchMode IVF, the nprobe knob, posting list
+// updates on insert / remove
+// ====================================================
+void test_016() {
+    cout << "\n=== Test 016: IVF Index ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, gridEmbedding, ref);
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    vs.addTexts(texts);
+    vs.enableIVF(EUCLIDEAN, 25);
+
+    vector<float> query = {12.2, 30.4};
+    for (int nprobe : {1, 4}) {
+        vs.setNProbe(nprobe);
+        int* ids = vs.topKNearest(query, 5, EUCLIDEAN, IVF);
+        cout << "nprobe " << nprobe << ": nearest id " << ids[0] << ", "
+             << vs.getLastDistanceEvaluations() << " distances computed" << endl;
+        delete[] ids;
+    }
+
+    // The nearest record leaves its posting list; re-adding it puts it back
+    vs.removeById(1512);
+    cout << "After removal: " << vs.findNearest(query, EUCLIDEAN, IVF) << endl;
+    vs.addText("1512");
+    cout << "After re-adding: " << vs.findNearest(query, EUCLIDEAN, IVF) << endl;
+}
+
+// ====================================================
+// TEST 017: Product Quantization
+// Covers: topKNearest / rangeQuery with SearchMode PQ, exact re-rank
+// ====================================================
+void test_017() {
+    cout << "\n=== Test 017: Product Quantization ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, gridEmbedding, ref);
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    vs.addTexts(texts);
+    vs.enablePQ(2); // one byte per coordinate
+
+    vector<float> query = {12.2, 30.4};
+    for (int depth : {0, 20}) {
+        vs.setRerankDepth(depth);
+        int* ids = vs.topKNearest(query, 3, EUCLIDEAN, PQ);
+        cout << "Re-rank depth " << depth << ": " << ids[0] << " " << ids[1] << " " << ids[2]
+             << " (" << vs.getLastDistanceEvaluations() << " records scored)" << endl;
+        delete[] ids;
+    }
+
+    int* ids = vs.rangeQuery(query, 0.7, EUCLIDEAN, PQ);
+    cout << "Range 0.7 around the query: " << ids[0] << " (" << vs.getLastDistanceEvaluations()
+         << " records scored)" << endl;
+    delete[] ids;
+}
+
+// ====================================================
+// TEST 018: Quantized Scan Recall (benchmark)
+// Covers: recall@10 of the INT8 and PQ modes against EXACT, with and without re-rank
+// ====================================================
+// Deterministic pseudo-random 32-d vector per text
+vector<float>* hashEmbedding(const string& text) {
+    unsigned int h = 2166136261u;
+    for (char c : text) h = (h ^ (unsigned char)c) * 16777619u;
+    vector<float>* vec = new vector<float>();
+    for (int i = 0; i < 32; ++i) {
+        h = h * 1103515245u + 12345u;
+        vec->push_back((float)((h >> 8) % 2001) / 1000.0f - 1.0f);
+    }
+    return vec;
+}
+
+// Mean share of the exact top 10 that `mode` also returns
+double recallAt10(VectorStore& vs, Metric metric, SearchMode mode) {
+    int shared = 0, queries = 20;
+    for (int q = 0; q < queries; ++q) {
+        vector<float>* query = hashEmbedding("query" + to_string(q));
+        int* exact = vs.topKNearest(*query, 10, metric, EXACT);
+        int* approx = vs.topKNearest(*query, 10, metric, mode);
+        for (int i = 0; i < 10; ++i)
+            for (int j = 0; j < 10; ++j)
+                if (exact[i] == approx[j]) shared++;
+        delete[] exact;
+        delete[] approx;
+        delete query;
+    }
+    return shared / (10.0 * queries);
+}
+
+void test_018() {
+    cout << "\n=== Test 018: Quantized Scan Recall ===" << endl;
+    VectorStore vs(32, hashEmbedding, vector<float>(32, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 2000; ++i) texts.push_back("doc" + to_string(i));
+    vs.addTexts(texts);
+    vs.enableInt8();
+    vs.enablePQ(8);
+
+    for (int depth : {0, 20}) {
+        vs.setRerankDepth(depth);
+        cout << "Re-rank " << depth << ": int8 euclidean " << recallAt10(vs, EUCLIDEAN, INT8)
+             << ", int8 cosine " << recallAt10(vs, COSINE, INT8)
+             << ", pq euclidean " << recallAt10(vs, EUCLIDEAN, PQ) << endl;
+    }
+}
+
+// ====================================================
+// TEST 019: Half-Precision Storage
+// Covers: FP16 / BF16 rounding at ingest, float getVector, exact top-k over
+// the 16-bit rows, converting a non-empty store
+// ====================================================
+// Share of the exact top 10 of `a` that `b` also returns
+double sharedTop10(VectorStore& a, VectorStore& b, Metric metric) {
+    int shared = 0, queries = 20;
+    for (int q = 0; q < queries; ++q) {
+        vector<float>* query = hashEmbedding("query" + to_string(q));
+        int* first = a.topKNearest(*query, 10, metric, EXACT);
+        int* second = b.topKNearest(*query, 10, metric, EXACT);
+        for (int i = 0; i < 10; ++i)
+            for (int j = 0; j < 10; ++j)
+                if (first[i] == second[j]) shared++;
+        delete[] first;
+        delete[] second;
+        delete query;
+    }
+    return shared / (10.0 * queries);
+}
+
+void test_019() {
+    cout << "\n=== Test 019: Half-Precision Storage ===" << endl;
+    vector<string> texts;
+    for (int i = 0; i < 2000; ++i) texts.push_back("doc" + to_string(i));
+    VectorStore full(32, hashEmbedding, vector<float>(32, 0.0f));
+    VectorStore half(32, hashEmbedding, vector<float>(32, 0.0f));
+    VectorStore brain(32, hashEmbedding, vector<float>(32, 0.0f));
+    half.setStoragePrecision(FP16);
+    brain.setStoragePrecision(BF16);
+    full.addTexts(texts);
+    half.addTexts(texts);
+    brain.addTexts(texts);
+
+    // getVector hands out floats holding the rounded values
+    cout << setprecision(8) << "doc1[0]: fp32 " << full.getVector(1)->vector[0]
+         << ", fp16 " << half.getVector(1)->vector[0]
+         << ", bf16 " << brain.getVector(1)->vector[0] << setprecision(4) << endl;
+    cout << "Top-10 shared with fp32: fp16 euclidean " << sharedTop10(full, half, EUCLIDEAN)
+         << ", fp16 cosine " << sharedTop10(full, half, COSINE)
+         << ", bf16 euclidean " << sharedTop10(full, brain, EUCLIDEAN) << endl;
+
+    // Converting rounds the stored rows: same store as one built at FP16
+    full.setStoragePrecision(FP16);
+    cout << "Converted to fp16: x[0] " << (full.getVector(1)->vector[0] == half.getVector(1)->vector[0] ? "matches" : "differs")
+         << ", top-10 shared " << sharedTop10(full, half, MANHATTAN) << endl;
+}
+
+// ====================================================
+// TEST 020: SimHash Cosine Prefilter
+// Covers: recall@10 of the SIMHASH mode against EXACT at two candidate
+// counts, distance evaluations, non-cosine metric rejected
+// ====================================================
+void test_020() {
+    cout << "\n=== Test 020: SimHash Cosine Prefilter ===" << endl;
+    VectorStore vs(32, hashEmbedding, vector<float>(32, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 2000; ++i) texts.push_back("doc" + to_string(i));
+    vs.addTexts(texts);
+    vs.enableSimHash(256);
+
+    for (int candidates : {0, 100, 400}) {
+        vs.setSimHashCandidates(candidates);
+        cout << "Candidates " << candidates << ": cosine recall " << recallAt10(vs, COSINE, SIMHASH)
+             << " (" << vs.getLastDistanceEvaluations() << " distance evaluations)" << endl;
+    }
+
+    vector<float>* query = hashEmbedding("query0");
+    try {
+        vs.topKNearest(*query, 10, EUCLIDEAN, SIMHASH);
+    } catch (const exception& e) {
+        cout << "Euclidean SIMHASH: " << e.what() << endl;
+    }
+    delete query;
+}
+
+// ====================================================
+// TEST 021: K-D Tree Box Query
+// Covers: boundingBoxQuery through the k-d tree matches the full scan (AVL
+// order, strict bounds), rows tested, tree kept up to date by removeAt
+// ====================================================
+void test_021() {
+    cout << "\n=== Test 021: K-D Tree Box Query ===" << endl;
+    VectorStore scan(2, gridEmbedding, vector<float>(2, 0.0f));
+    VectorStore tree(2, gridEmbedding, vector<float>(2, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    scan.addTexts(texts);
+    tree.addTexts(texts);
+    tree.enableKDTree(8);
+
+    // x in {11..14}, y in {11, 12}: 8 points (the bounds themselves are out)
+    vector<float> minBound = {10.0f, 10.0f}, maxBound = {15.0f, 13.0f};
+    for (int round = 0; round < 2; ++round) {
+        int* expected = scan.boundingBoxQuery(minBound, maxBound);
+        int* ids = tree.boundingBoxQuery(minBound, maxBound);
+        int size = round == 0 ? 8 : 7;
+        bool same = true;
+        for (int i = 0; i < size; ++i) same = same && ids[i] == expected[i];
+        cout << "Box ids: ";
+        printArray(ids, size);
+        cout << (same ? "Same as the full scan" : "Differs from the full scan") << " (rows tested: "
+             << scan.getLastDistanceEvaluations() << " vs " << tree.getLastDistanceEvaluations() << ")" << endl;
+        delete[] expected;
+        delete[] ids;
+
+        scan.removeById(11 * 50 + 12); // (12, 11)
+        tree.removeById(11 * 50 + 12);
+    }
+}
+
+// ====================================================
+// TEST 022: Subtree Bounds Pruning
+// Covers: AVL subtree boxes over the first dimensions, boundingBoxQuery and
+// euclidean rangeQuery results unchanged, rows tested with and without
+// ====================================================
+void test_022() {
+    cout << "\n=== Test 022: Subtree Bounds Pruning ===" << endl;
+    VectorStore scan(2, gridEmbedding, vector<float>(2, 0.0f));
+    VectorStore bounded(2, gridEmbedding, vector<float>(2, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    scan.addTexts(texts);
+    bounded.addTexts(texts);
+    bounded.setSubtreeBoundDims(1); // x only
+    bounded.removeById(11 * 50 + 12); // kept up to date by removals
+    scan.removeById(11 * 50 + 12);
+
+    // Same box as test 021: 7 points left
+    int* expected = scan.boundingBoxQuery({10.0f, 10.0f}, {15.0f, 13.0f});
+    int* ids = bounded.boundingBoxQuery({10.0f, 10.0f}, {15.0f, 13.0f});
+    bool same = true;
+    for (int i = 0; i < 7; ++i) same = same && ids[i] == expected[i];
+    cout << "Box: " << (same ? "same as" : "differs from") << " the full walk (rows tested: "
+         << scan.getLastDistanceEvaluations() << " vs " << bounded.getLastDistanceEvaluations() << ")" << endl;
+    delete[] expected;
+    delete[] ids;
+
+    // Radius 1.5 around (30, 20): the 3 x 3 block of grid points centred on it
+    vector<float> query = {30.0f, 20.0f};
+    expected = scan.rangeQuery(query, 1.5, EUCLIDEAN);
+    ids = bounded.rangeQuery(query, 1.5, EUCLIDEAN);
+    same = true;
+    for (int i = 0; i < 9; ++i) same = same && ids[i] == expected[i];
+    cout << "Range: " << (same ? "same as" : "differs from") << " the full walk (rows tested: "
+         << scan.getLastDistanceEvaluations() << " vs " << bounded.getLastDistanceEvaluations() << ")" << endl;
+    delete[] expected;
+    delete[] ids;
+}
+
+// ====================================================
+// TEST 023: Root Policy Under Interleaved Reads
+// Covers: getRootVector after every addText on a stream whose root keeps
+// changing, against the eager closest-to-average rule; AVL order intact
+// ====================================================
+// "<i>" -> one value that alternates around 1000 and closes in on it, so the
+// newest record is often the one closest to the average
+vector<float>* convergingEmbedding(const string& text) {
+    int i = stoi(text);
+    return new vector<float>{1000.0f + (i % 2 ? 1.0f : -1.0f) * 1000.0f / (i + 1)};
+}
+
+void test_023() {
+    cout << "\n=== Test 023: Root Policy Under Interleaved Reads ===" << endl;
+    VectorStore vs(1, convergingEmbedding, vector<float>(1, 0.0f));
+    int expectedRoot = -1, matches = 0, changes = 0, reads = 3000;
+    for (int i = 0; i < reads; ++i) {
+        vs.addText(to_string(i));
+        // Eager rule: the new record becomes the root if it is strictly closer to the average
+        double average = vs.getAverageDistance();
+        VectorRecord* added = vs.getById(i);
+        if (expectedRoot == -1 || fabs(added->distanceFromReference - average)
+                                  < fabs(vs.getById(expectedRoot)->distanceFromReference - average)) {
+            if (expectedRoot != -1) changes++;
+            expectedRoot = i;
+        }
+        if (vs.getRootVector()->id == expectedRoot) matches++;
+    }
+    bool sorted = true;
+    vector<VectorRecord*> inOrder = vs.getAllVectorsSortedByDistance();
+    for (size_t i = 1; i < inOrder.size(); ++i) {
+        sorted = sorted && inOrder[i - 1]->distanceFromReference <= inOrder[i]->distanceFromReference;
+    }
+    cout << "Root matched the rule on " << matches << "/" << reads << " reads (" << changes
+         << " root changes), in-order walk " << (sorted ? "sorted" : "NOT sorted")
+         << " over " << inOrder.size() << " records" << endl;
+}
+
+// ====================================================
+// TEST 024: forEach Then Cosine Search
+// Covers: rows rescaled and sign-flipped by forEach, cached norms and the
+// norm index refreshed, cosine findNearest / topKNearest against brute force
+// ====================================================
+// Scales each row by 1..5 and flips every third one
+void rescaleRow(vector<float>& values, int id, string&) {
+    float factor = (float)(id % 5 + 1) * (id % 3 == 0 ? -1.0f : 1.0f);
+    for (float& value : values) value *= factor;
+}
+
+// Id of the record `metric`-closest to query, by a full scan of getVector rows
+int bruteForceNearest(VectorStore& vs, const vector<float>& query, Metric metric) {
+    int best = -1;
+    double bestScore = 0.0;
+    for (VectorRecord* rec : vs.getAllVectorsSortedByDistance()) {
+        vector<float> row = *rec->vector;
+        double score = metric == COSINE ? vs.cosineSimilarity(query, row)
+                     : metric == MANHATTAN ? vs.l1Distance(query, row) : vs.l2Distance(query, row);
+        bool better = metric == COSINE ? score > bestScore : score < bestScore;
+        if (best == -1 || better) {
+            best = rec->id;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+void test_024() {
+    cout << "\n=== Test 024: forEach Then Cosine Search ===" << endl;
+    VectorStore vs(32, hashEmbedding, vector<float>(32, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 500; ++i) texts.push_back("doc" + to_string(i));
+    vs.addTexts(texts);
+    vs.forEach(rescaleRow);
+
+    int nearestRight = 0, topRight = 0, queries = 20;
+    for (int q = 0; q < queries; ++q) {
+        vector<float>* query = hashEmbedding("query" + to_string(q));
+        int expected = bruteForceNearest(vs, *query, COSINE);
+        if (vs.findNearest(*query, COSINE) == expected) nearestRight++;
+        int* top = vs.topKNearest(*query, 5, COSINE, EXACT);
+        if (top[0] == expected) topRight++;
+        delete[] top;
+        delete query;
+    }
+    cout << "Cosine after forEach: findNearest " << nearestRight << "/" << queries
+         << ", topKNearest[0] " << topRight << "/" << queries << " match brute force" << endl;
+}
+
+// ====================================================
+// TEST 025: forEach Then Distance Order
+// Covers: rows moved by forEach, distances to the reference, AVL keys, root
+// and average refreshed; getAllIdsSortedByDistance and the rangeQuery annulus
+// against a store built from the moved rows
+// ====================================================
+// Moves a grid point by (10, 5)
+void shiftRow(vector<float>& values, int, string&) {
+    values[0] += 10.0f;
+    values[1] += 5.0f;
+}
+
+// gridEmbedding, already moved by shiftRow
+vector<float>* shiftedGridEmbedding(const string& text) {
+    vector<float>* point = gridEmbedding(text);
+    (*point)[0] += 10.0f;
+    (*point)[1] += 5.0f;
+    return point;
+}
+
+void test_025() {
+    cout << "\n=== Test 025: forEach Then Distance Order ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore moved(2, gridEmbedding, ref);
+    VectorStore fresh(2, shiftedGridEmbedding, ref);
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    moved.addTexts(texts);
+    fresh.addTexts(texts);
+    moved.forEach(shiftRow);
+
+    double average = moved.getAverageDistance();
+    double closest = -1.0;
+    for (VectorRecord* rec : moved.getAllVectorsSortedByDistance()) {
+        double diff = fabs(rec->distanceFromReference - average);
+        if (closest < 0.0 || diff < closest) closest = diff;
+    }
+    cout << "Sorted ids: " << (moved.getAllIdsSortedByDistance() == fresh.getAllIdsSortedByDistance() ? "same" : "differ")
+         << ", average " << average << " vs " << fresh.getAverageDistance() << ", root "
+         << (fabs(moved.getRootVector()->distanceFromReference - average) == closest ? "is" : "is not")
+         << " the record closest to the average" << endl;
+
+    // Radius 1.5 around the moved (30, 20): the 3 x 3 block of grid points centred on it
+    vector<float> query = {40.0f, 25.0f};
+    int* expected = fresh.rangeQuery(query, 1.5, EUCLIDEAN);
+    int* ids = moved.rangeQuery(query, 1.5, EUCLIDEAN);
+    bool same = true;
+    for (int i = 0; i < 9; ++i) same = same && ids[i] == expected[i];
+    cout << "Range: " << (same ? "same as" : "differs from") << " the store built from the moved rows" << endl;
+    delete[] expected;
+    delete[] ids;
+}
+
+// ====================================================
+// TEST 026: forEach With Pivots
+// Covers: pivot table rebuilt after forEach moves the rows, euclidean
+// findNearest / topKNearest with pivot pruning against brute force
+// ====================================================
+void test_026() {
+    cout << "\n=== Test 026: forEach With Pivots ===" << endl;
+    vector<float> ref = {0.0, 0.0};
+    VectorStore vs(2, gridEmbedding, ref);
+    vector<string> texts;
+    for (int i = 0; i < 2500; ++i) texts.push_back(to_string(i));
+    vs.addTexts(texts);
+    vs.setPivotCount(4);
+    vs.forEach(shiftRow);
+
+    int nearestRight = 0, topRight = 0, queries = 20;
+    for (int q = 0; q < queries; ++q) {
+        // Just off the moved grid point (x, y) = (7q % 50, 3q)
+        vector<float> query = {(float)(7 * q % 50) + 10.1f, (float)(3 * q) + 5.2f};
+        int expected = bruteForceNearest(vs, query, EUCLIDEAN);
+        if (vs.findNearest(query, EUCLIDEAN) == expected) nearestRight++;
+        int* top = vs.topKNearest(query, 5, EUCLIDEAN, EXACT);
+        if (top[0] == expected) topRight++;
+        delete[] top;
+    }
+    cout << "Euclidean with " << vs.getPivotCount() << " pivots after forEach: findNearest " << nearestRight << "/" << queries
+         << ", topKNearest[0] " << topRight << "/" << queries << " match brute force" << endl;
+}
+
+// ====================================================
+// TEST 027: PQ Without Float Rows
+// Covers: dropFloatRows with PQ, code-only searches unchanged, re-rank
+// ignored, addTexts / removeById afterwards, row readers refused, clear
+// ====================================================
+// Top 10 by `mode` in both stores, compared position by position
+bool sameTop10(VectorStore& a, VectorStore& b, Metric metric, SearchMode mode) {
+    bool same = true;
+    for (int q = 0; q < 20; ++q) {
+        vector<float>* query = hashEmbedding("query" + to_string(q));
+        int* first = a.topKNearest(*query, 10, metric, mode);
+        int* second = b.topKNearest(*query, 10, metric, mode);
+        for (int i = 0; i < 10; ++i) same = same && first[i] == second[i];
+        delete[] first;
+        delete[] second;
+        delete query;
+    }
+    return same;
+}
+
+void test_027() {
+    cout << "\n=== Test 027: PQ Without Float Rows ===" << endl;
+    VectorStore kept(32, hashEmbedding, vector<float>(32, 0.0f));
+    VectorStore dropped(32, hashEmbedding, vector<float>(32, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 2000; ++i) texts.push_back("doc" + to_string(i));
+    kept.addTexts(texts);
+    dropped.addTexts(texts);
+    kept.enablePQ(8);
+    dropped.enablePQ(8);
+    dropped.dropFloatRows();
+    cout << "Float rows: " << (dropped.hasFloatRows() ? "kept" : "dropped") << endl;
+
+    // Same codes, so the same ranking; the re-rank depth has nothing to read
+    dropped.setRerankDepth(20);
+    cout << "PQ top 10 without rows: " << (sameTop10(kept, dropped, EUCLIDEAN, PQ) ? "same" : "differs")
+         << " (euclidean), " << (sameTop10(kept, dropped, COSINE, PQ) ? "same" : "differs") << " (cosine)" << endl;
+
+    // New texts are encoded from the staged row; removals need no row
+    vector<string> more;
+    for (int i = 2000; i < 2500; ++i) more.push_back("doc" + to_string(i));
+    kept.addTexts(more);
+    dropped.addTexts(more);
+    kept.addText("late");
+    dropped.addText("late");
+    kept.removeById(7);
+    dropped.removeById(7);
+    cout << "After adds and a removal: " << (sameTop10(kept, dropped, EUCLIDEAN, PQ) ? "same" : "differs")
+         << ", " << dropped.size() << " records" << endl;
+
+    try {
+        dropped.findNearest(vector<float>(32, 0.5f), EUCLIDEAN, EXACT);
+        cout << "EXACT search ran without rows" << endl;
+    } catch (const logic_error& e) {
+        cout << "EXACT search: " << e.what() << endl;
+    }
+
+    dropped.clear();
+    dropped.addTexts(texts);
+    vector<float>* query = hashEmbedding("doc5");
+    cout << "After clear: float rows " << (dropped.hasFloatRows() ? "kept" : "dropped")
+         << ", nearest to doc5 is " << dropped.findNearest(*query, EUCLIDEAN) << endl;
+    delete query;
+}
+
+// ====================================================
+// TEST 028: Int8 Without Float Rows
+// Covers: dropFloatRows with INT8 codes only, code-only searches unchanged,
+// addTexts afterwards, the last copy of the rows kept from being disabled
+// ====================================================
+void test_028() {
+    cout << "\n=== Test 028: Int8 Without Float Rows ===" << endl;
+    VectorStore kept(32, hashEmbedding, vector<float>(32, 0.0f));
+    VectorStore dropped(32, hashEmbedding, vector<float>(32, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 2000; ++i) texts.push_back("doc" + to_string(i));
+    kept.addTexts(texts);
+    dropped.addTexts(texts);
+    kept.enableInt8();
+    dropped.enableInt8();
+    dropped.dropFloatRows();
+    dropped.setRerankDepth(20);
+    cout << "INT8 top 10 without rows: " << (sameTop10(kept, dropped, EUCLIDEAN, INT8) ? "same" : "differs")
+         << " (euclidean), " << (sameTop10(kept, dropped, COSINE, INT8) ? "same" : "differs") << " (cosine)" << endl;
+
+    vector<string> more;
+    for (int i = 2000; i < 2500; ++i) more.push_back("doc" + to_string(i));
+    kept.addTexts(more);
+    dropped.addTexts(more);
+    cout << "After adds: " << (sameTop10(kept, dropped, MANHATTAN, INT8) ? "same" : "differs") << endl;
+
+    try {
+        dropped.disableInt8();
+        cout << "Int8 codes disabled without rows" << endl;
+    } catch (const logic_error& e) {
+        cout << "disableInt8: " << e.what() << endl;
+    }
+}
+
+// ====================================================
+// TEST 029: Reference Vector Of Another Length
+// Covers: constructor and setReferenceVector pad / truncate the reference
+// to the store dimension, distances computed over the padded reference
+// ====================================================
+void test_029() {
+    cout << "\n=== Test 029: Reference Vector Of Another Length ===" << endl;
+    VectorStore vs(32, hashEmbedding, {0.0, 0.0}); // padded with zeros
+    vs.addText("doc1");
+    vector<float> row = *vs.getVector(0)->vector;
+    cout << "Short reference: " << vs.getReferenceVector()->size() << " floats, distance "
+         << (vs.getVector(0)->distanceFromReference == vs.l2Distance(row, vector<float>(32, 0.0f)) ? "matches" : "differs from")
+         << " the zero vector's" << endl;
+
+    vs.setReferenceVector(vector<float>(40, 1.0f)); // truncated
+    cout << "Long reference: " << vs.getReferenceVector()->size() << " floats, distance "
+         << (vs.getVector(0)->distanceFromReference == vs.l2Distance(row, vector<float>(32, 1.0f)) ? "matches" : "differs from")
+         << " the ones vector's" << endl;
+}
+
+// ====================================================
+// TEST 030: forEach Then Index Searches
+// Covers: forEach rewriting every row, then findNearest through the
+// indexes built from the old rows, against brute force
+// ====================================================
+// Overwrites row `id` with the embedding of doc (7 * id) % 500: every row moves
+void permuteRow(vector<float>& values, int id, string&) {
+    vector<float>* moved = hashEmbedding("doc" + to_string(7 * id % 500));
+    values = *moved;
+    delete moved;
+}
+
+// How many of 20 queries (each equal to some row) `mode` answers like a full scan
+int nearestLikeBruteForce(VectorStore& vs, Metric metric, SearchMode mode) {
+    int right = 0;
+    for (int q = 0; q < 20; ++q) {
+        vector<float>* query = hashEmbedding("doc" + to_string(13 * q % 500));
+        if (vs.findNearest(*query, metric, mode) == bruteForceNearest(vs, *query, metric)) right++;
+        delete query;
+    }
+    return right;
+}
+
+void test_030() {
+    cout << "\n=== Test 030: forEach Then Index Searches ===" << endl;
+    VectorStore vs(32, hashEmbedding, vector<float>(32, 0.0f));
+    vector<string> texts;
+    for (int i = 0; i < 500; ++i) texts.push_back("doc" + to_string(i));
+    vs.addTexts(texts);
+    vs.enableHNSW(EUCLIDEAN);
+    vs.enableIVF(EUCLIDEAN, 16);
+    vs.setNProbe(1);
+    vs.enablePQ(8);
+    vs.setRerankDepth(20);
+    vs.enableInt8();
+    vs.enableSimHash();
+    vs.setSimHashCandidates(20);
+    vs.forEach(permuteRow);
+
+    cout << "Nearest after forEach, of 20 like brute force: HNSW " << nearestLikeBruteForce(vs, EUCLIDEAN, HNSW)
+         << ", IVF " << nearestLikeBruteForce(vs, EUCLIDEAN, IVF)
+         << ", PQ " << nearestLikeBruteForce(vs, EUCLIDEAN, PQ)
+         << ", INT8 " << nearestLikeBruteForce(vs, EUCLIDEAN, INT8)
+         << ", SIMHASH (cosine) " << nearestLikeBruteForce(vs, COSINE, SIMHASH) << endl;
+}
+
 int main() {
     //test_001();
     //test_002();
@@ -446,5 +1290,29 @@ int main() {
     //test_004();
     test_005();
     test_006();
+    test_007();
+    test_008();
+    test_009();
+    test_010();
+    test_011();
+    test_012();
+    test_013();
+    test_014();
+    test_015();
+    test_016();
+    test_017();
+    test_018();
+    test_019();
+    test_020();
+    test_021();
+    test_022();
+    test_023();
+    test_024();
+    test_025();
+    test_026();
+    test_027();
+    test_028();
+    test_029();
+    test_030();
     return 0;
 }
\ No newline at end of file